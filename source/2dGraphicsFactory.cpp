@@ -50,6 +50,83 @@ BatchGeometryPtr GraphicsFactory2d::drawPolygon (const Polygon& _p, const Color&
     return polygeom;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//Draws many lines
+////////////////////////////////////////////////////////////////////////////////
+
+BatchGeometryPtr GraphicsFactory2d::drawLines( const Vector2d* _v, unsigned int _n, const Color* _c )
+{
+    BatchGeometryPtr linegeom = new BatchGeometry( renderer, GL_LINES, getTexture(), getGroup(), getDepth() );
+    linegeom->setImmediate( true );
+    linegeom->reserve( _n * 2 );
+
+    for( unsigned int i = 0; i < _n * 2; i += 2 )
+    {
+        linegeom->addVertex( Vertex( _v[i], _c ? _c[i] : Color(255,255,255), TextureCoords(0,0) ) );
+        linegeom->addVertex( Vertex( _v[i+1], _c ? _c[i+1] : Color(255,255,255), TextureCoords(1,1) ) );
+    }
+
+    return linegeom;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Draws many rectangles
+////////////////////////////////////////////////////////////////////////////////
+
+BatchGeometryPtr GraphicsFactory2d::drawRectangles( const Rectangle* _r, unsigned int _n, const Color* _c )
+{
+    BatchGeometryPtr rectgeom = new BatchGeometry( renderer, GL_QUADS, getTexture(), getGroup(), getDepth() );
+    rectgeom->setImmediate( true );
+    rectgeom->reserve( _n * 4 );
+
+    // Same vertices as BatchGeometry::fromRectangle().
+    for( unsigned int i = 0; i < _n; ++i )
+    {
+        const Vector2d& p = _r[i].getPosition();
+        const Vector2d& s = _r[i].getSize();
+        const Color c = _c ? _c[i] : Color(255,255,255);
+        rectgeom->addVertex( Vertex( Vector2d(0,0) + p, c, TextureCoords(0,0) ) );
+        rectgeom->addVertex( Vertex( Vector2d(0, s.getY()) + p, c, TextureCoords(0,1) ) );
+        rectgeom->addVertex( Vertex( s + p, c, TextureCoords(1,1) ) );
+        rectgeom->addVertex( Vertex( Vector2d(s.getX(), 0) + p, c, TextureCoords(1,0) ) );
+    }
+
+    return rectgeom;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Draws many polygons
+////////////////////////////////////////////////////////////////////////////////
+
+BatchGeometryPtr GraphicsFactory2d::drawPolygons( const Polygon* _p, unsigned int _n, const Color* _c )
+{
+    BatchGeometryPtr polygeom = new BatchGeometry( renderer, GL_TRIANGLES, getTexture(), getGroup(), getDepth() );
+    polygeom->setImmediate( true );
+
+    unsigned int count = 0;
+    for( unsigned int i = 0; i < _n; ++i )
+    {
+        if( _p[i].getVertexCount() > 2 ) count += _p[i].getVertexCount() * 3;
+    }
+    polygeom->reserve( count );
+
+    // Same triangle expansion as BatchGeometry::fromPolygon().
+    for( unsigned int i = 0; i < _n; ++i )
+    {
+        const Polygon& poly = _p[i];
+        if( poly.getVertexCount() <= 2 ) continue;
+        const Color c = _c ? _c[i] : Color(255,255,255);
+        for( signed int j = 0; j < (signed int)poly.getVertexCount(); ++j )
+        {
+            polygeom->addVertex( Vertex( poly.getPosition() + poly.getVertex(j+1), c ) );
+            polygeom->addVertex( Vertex( poly.getPosition() + poly.getVertex(j), c ) );
+            polygeom->addVertex( Vertex( poly.getPosition(), c ) );
+        }
+    }
+
+    return polygeom;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //Draws a polygon
 ////////////////////////////////////////////////////////////////////////////////
@@ -84,39 +161,50 @@ BatchGeometryPtr GraphicsFactory2d::drawTexturedPolygon (const Polygon& _p, Text
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//Adds the vertices of a single sprite
+////////////////////////////////////////////////////////////////////////////////
+
+void GraphicsFactory2d::emitSprite( BatchGeometryPtr& _g, const Vector2d& _size, const Vector2d& _p, const TextureCoords& _uv0, const TextureCoords& _uv1, const RotationMatrix& _rot, const Vector2d& _scale, const Color& _color, unsigned int _flags )
+{
+    // The sprite is centered on the origin, scaled, rotated, and then translated back.
+    // The operations (and their order) are the same as scale(), rotate() and translate()
+    // so the result is identical to transforming a rectangle made by fromRectangle().
+    const Vector2d origin = -_size/2.0f;
+    const Vector2d t = _p + _size/2.0f;
+    const float x[4] = { 0.0f + origin.getX(), 0.0f + origin.getX(), _size.getX() + origin.getX(), _size.getX() + origin.getX() };
+    const float y[4] = { 0.0f + origin.getY(), _size.getY() + origin.getY(), _size.getY() + origin.getY(), 0.0f + origin.getY() };
+
+    // Corner texture coordinates, (0,0), (0,1), (1,1), (1,0) for a whole texture.
+    float u[4] = { _uv0.u, _uv0.u, _uv1.u, _uv1.u };
+    float v[4] = { _uv0.v, _uv1.v, _uv1.v, _uv0.v };
+
+    for( unsigned int i = 0; i < 4; ++i )
+    {
+        const float sx = x[i] * _scale.getX();
+        const float sy = y[i] * _scale.getY();
+        Vector2d position( ( ( _rot.getElement(0) * sx ) + ( _rot.getElement(1) * sy ) ) + t.getX(),
+                           ( ( _rot.getElement(2) * sx ) + ( _rot.getElement(3) * sy ) ) + t.getY(),
+                           ( 0.0f + origin.getZ() ) + t.getZ() );
+
+        if( _flags & EGF_HFLIP ) u[i] = ( - u[i] ) + 1.0f;
+        if( _flags & EGF_VFLIP ) v[i] = ( - v[i] ) + 1.0f;
+
+        _g->addVertex( Vertex( position, _color, TextureCoords( u[i], v[i] ) ) );
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //Renders a Texture
 ////////////////////////////////////////////////////////////////////////////////
 
 BatchGeometryPtr GraphicsFactory2d::drawTexture(  TexturePtr _t, const Vector2d& _p,  const RotationMatrix& _rot, const Vector2d& _scale, const Color& _color, unsigned int _flags )
 {
-    // Use BatchGeometry's factory for rectangles.
-	BatchGeometryPtr geom = new BatchGeometry( renderer, Rectangle( -_t->getSize()/2.0f, _t->getSize()) , _t, getGroup(), getDepth() );
+    BatchGeometryPtr geom = new BatchGeometry( renderer, GL_QUADS, _t, getGroup(), getDepth() );
     geom->setImmediate( true );
+    geom->reserve( 4 );
 
-    // scale, rotate it, and then translate it.
-    geom->scale( _scale );
-    geom->rotate( _rot );
-    geom->translate( _p + _t->getSize()/2.0f );
-
-    // colorize
-    geom->colorize( _color );
-
-    // Flip tcoords
-    if( _flags & EGF_HFLIP )
-    {
-        (*geom)[0].tcoords.u = ( - (*geom)[0].tcoords.u ) + 1.0f; 
-        (*geom)[1].tcoords.u = ( - (*geom)[1].tcoords.u ) + 1.0f; 
-        (*geom)[2].tcoords.u = ( - (*geom)[2].tcoords.u ) + 1.0f; 
-        (*geom)[3].tcoords.u = ( - (*geom)[3].tcoords.u ) + 1.0f; 
-    }
-    if( _flags & EGF_VFLIP )
-    {
-        (*geom)[0].tcoords.v = ( - (*geom)[0].tcoords.v ) + 1.0f; 
-        (*geom)[1].tcoords.v = ( - (*geom)[1].tcoords.v ) + 1.0f; 
-        (*geom)[2].tcoords.v = ( - (*geom)[2].tcoords.v ) + 1.0f; 
-        (*geom)[3].tcoords.v = ( - (*geom)[3].tcoords.v ) + 1.0f; 
-    }
+    emitSprite( geom, _t->getSize(), _p, TextureCoords(0,0), TextureCoords(1,1), _rot, _scale, _color, _flags );
 
     // return it
     return geom;
@@ -125,43 +213,44 @@ BatchGeometryPtr GraphicsFactory2d::drawTexture(  TexturePtr _t, const Vector2d&
 //this draws a texture with a clipping rectangle
 BatchGeometryPtr GraphicsFactory2d::drawTexturePart( TexturePtr _t, const Vector2d& _p, const Rectangle& _rect, const RotationMatrix& _rot, const Vector2d& _scale, const Color& _color, unsigned int  _flags )
 {
-    // Use BatchGeometry's factory for rectangles.
-    BatchGeometryPtr geom = new BatchGeometry( renderer, Rectangle( -_rect.getSize()/2, _rect.getSize() ) , _t, getGroup(), getDepth() );
+    BatchGeometryPtr geom = new BatchGeometry( renderer, GL_QUADS, _t, getGroup(), getDepth() );
     geom->setImmediate( true );
-
-    // scale, rotate it, and then translate it.
-    geom->scale( _scale );
-    geom->rotate( _rot );
-    geom->translate( _p + _rect.getSize()/2.0f );
-
-    // colorize
-    geom->colorize( _color );
+    geom->reserve( 4 );
 
     // Define tcoords.
     Vector2d originuv( _rect.getX()/_t->getWidth(), _rect.getY()/_t->getHeight() );
     Vector2d spanuv( _rect.getWidth()/_t->getWidth(), _rect.getHeight()/_t->getHeight() );
 
-    (*geom)[3].tcoords = TextureCoords( (originuv+spanuv).getX(), originuv.getY() );
-    (*geom)[2].tcoords = TextureCoords( (originuv+spanuv).getX(), (originuv+spanuv).getY() );
-    (*geom)[1].tcoords = TextureCoords( originuv.getX(), (originuv+spanuv).getY()  );
-    (*geom)[0].tcoords = TextureCoords( originuv.getX(), originuv.getY() );
+    emitSprite( geom, _rect.getSize(), _p, TextureCoords( originuv.getX(), originuv.getY() ), TextureCoords( (originuv+spanuv).getX(), (originuv+spanuv).getY() ), _rot, _scale, _color, _flags );
 
-    // Flip tcoords
-    if( _flags & EGF_HFLIP )
-    {
-        (*geom)[0].tcoords.u = ( - (*geom)[0].tcoords.u ) + 1.0f; 
-        (*geom)[1].tcoords.u = ( - (*geom)[1].tcoords.u ) + 1.0f; 
-        (*geom)[2].tcoords.u = ( - (*geom)[2].tcoords.u ) + 1.0f; 
-        (*geom)[3].tcoords.u = ( - (*geom)[3].tcoords.u ) + 1.0f; 
-    }
-    if( _flags & EGF_VFLIP )
+    // return it
+    return geom;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//Renders many sprites
+////////////////////////////////////////////////////////////////////////////////
+
+BatchGeometryPtr GraphicsFactory2d::drawSprites( TexturePtr _t, const SpriteDescriptor* _s, unsigned int _n )
+{
+    BatchGeometryPtr geom = new BatchGeometry( renderer, GL_QUADS, _t, getGroup(), getDepth() );
+    geom->setImmediate( true );
+    geom->reserve( _n * 4 );
+
+    for( unsigned int i = 0; i < _n; ++i )
     {
-        (*geom)[0].tcoords.v = ( - (*geom)[0].tcoords.v ) + 1.0f; 
-        (*geom)[1].tcoords.v = ( - (*geom)[1].tcoords.v ) + 1.0f; 
-        (*geom)[2].tcoords.v = ( - (*geom)[2].tcoords.v ) + 1.0f; 
-        (*geom)[3].tcoords.v = ( - (*geom)[3].tcoords.v ) + 1.0f; 
+        const SpriteDescriptor& s = _s[i];
+        if( s.rect.getWidth() == 0.0f && s.rect.getHeight() == 0.0f )
+        {
+            emitSprite( geom, _t->getSize(), s.position, TextureCoords(0,0), TextureCoords(1,1), s.rotation, s.scale, s.color, s.flags );
+        }
+        else
+        {
+            Vector2d originuv( s.rect.getX()/_t->getWidth(), s.rect.getY()/_t->getHeight() );
+            Vector2d spanuv( s.rect.getWidth()/_t->getWidth(), s.rect.getHeight()/_t->getHeight() );
+            emitSprite( geom, s.rect.getSize(), s.position, TextureCoords( originuv.getX(), originuv.getY() ), TextureCoords( (originuv+spanuv).getX(), (originuv+spanuv).getY() ), s.rotation, s.scale, s.color, s.flags );
+        }
     }
 
-    // return it
     return geom;
 }
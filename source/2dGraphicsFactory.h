@@ -25,6 +25,26 @@ enum E_GEOMETRY_FLAGS
     EGF_VFLIP = 0x0002 //!< Vertical Flip
 };
 
+//! Sprite Descriptor
+/*!
+    Describes a single sprite for GraphicsFactory2d::drawSprites(). The members have the
+    same meaning as the parameters of GraphicsFactory2d::drawTexturePart(). If the rectangle
+    has no size, the whole texture is used (like GraphicsFactory2d::drawTexture()).
+*/
+struct SpriteDescriptor
+{
+    SpriteDescriptor( const Vector2d& _p = Vector2d(0,0), const Rectangle& _rect = Rectangle(0,0,0,0), const RotationMatrix& _rot = RotationMatrix(0.0f), const Vector2d& _scale = Vector2d(1.0f,1.0f), const Color& _color = Color(255,255,255), unsigned int _flags = EGF_NONE )
+        : position(_p), rect(_rect), rotation(_rot), scale(_scale), color(_color), flags(_flags)
+    {}
+
+    Vector2d position; //!< Where to draw it at.
+    Rectangle rect; //!< Region of the texture to use.
+    RotationMatrix rotation; //!< Rotation.
+    Vector2d scale; //!< Scale.
+    Color color; //!< Color.
+    unsigned int flags; //!< E_GEOMETRY_FLAGS.
+};
+
 //! Factory for creating common 2d graphics.
 /*!
     This class provides a factory for creating common 2d graphics
@@ -94,6 +114,39 @@ public:
     */
     BatchGeometryPtr drawPolygon (const Polygon& _p, const Color& _a = Color(255,255,255));
 
+    //! Draws many 2D line segments.
+    /*!
+        Draws every line segment into a single piece of geometry, which is much cheaper than calling drawLine()
+        for each one. This is a geometry factory.
+        \param _v The end points of the lines, two for each line (so there must be 2*_n).
+        \param _n The number of lines.
+        \param _c The color of each end point (2*_n), or null to make them all white.
+        \sa drawLine()
+    */
+    BatchGeometryPtr drawLines( const Vector2d* _v, unsigned int _n, const Color* _c = 0 );
+
+    //! Draws many rectangles.
+    /*!
+        Draws every rectangle into a single piece of geometry, which is much cheaper than calling drawRectangle()
+        for each one. This is a geometry factory.
+        \param _r The rectangles.
+        \param _n The number of rectangles.
+        \param _c The color of each rectangle (_n), or null to make them all white.
+        \sa drawRectangle()
+    */
+    BatchGeometryPtr drawRectangles( const Rectangle* _r, unsigned int _n, const Color* _c = 0 );
+
+    //! Draws many polygons.
+    /*!
+        Draws every polygon into a single piece of geometry, which is much cheaper than calling drawPolygon()
+        for each one. This is a geometry factory.
+        \param _p The polygons.
+        \param _n The number of polygons.
+        \param _c The color of each polygon (_n), or null to make them all white.
+        \sa drawPolygon()
+    */
+    BatchGeometryPtr drawPolygons( const Polygon* _p, unsigned int _n, const Color* _c = 0 );
+
     //! Draws a textured polygon.
     /*!
         Draws a polygon with the given depth and color and applies the given texture to the polygon. This function
@@ -133,9 +186,32 @@ public:
     */
     BatchGeometryPtr drawTexturePart( TexturePtr _t, const Vector2d& _p, const Rectangle& _rect, const RotationMatrix& _rot = RotationMatrix(0.0f), const Vector2d& _scale=Vector2d(1.0f,1.0f), const Color& _color=Color(255,255,255), unsigned int _flags = EGF_NONE );
 
+    //! Draws many sprites of the same texture.
+    /*!
+        Draws every sprite in the given array into a single piece of geometry (GL_QUADS, 4 vertices per sprite).
+        Each sprite is exactly what drawTexturePart() (or drawTexture() if its rectangle has no size) would make.
+        This is a geometry factory.
+        \param _t The texture to draw.
+        \param _s The first sprite.
+        \param _n The number of sprites.
+        \sa SpriteDescriptor, drawTexture(), drawTexturePart()
+    */
+    BatchGeometryPtr drawSprites( TexturePtr _t, const SpriteDescriptor* _s, unsigned int _n );
+
 
 protected:
 
+    //! Adds a sprite's four vertices to the given geometry.
+    /*!
+        Computes the final positions (scaled, rotated and translated), texture coordinates (flipped) and colors of the
+        sprite in a single pass, so the geometry never has to be moved or transformed afterward.
+        \param _g The geometry to add the vertices to.
+        \param _size The size of the sprite.
+        \param _uv0 The texture coordinates of the top-left corner.
+        \param _uv1 The texture coordinates of the bottom-right corner.
+    */
+    void emitSprite( BatchGeometryPtr& _g, const Vector2d& _size, const Vector2d& _p, const TextureCoords& _uv0, const TextureCoords& _uv1, const RotationMatrix& _rot, const Vector2d& _scale, const Color& _color, unsigned int _flags );
+
     BatchRenderer& renderer;
 };
 
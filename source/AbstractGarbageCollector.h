@@ -12,6 +12,12 @@ distribution for more information.
 #define __PH_AB_GC_H__
 
 #include "config.h"
+#include "RecycleQueue.h"
+#include "Droppable.h"
+#include <vector>
+#include <utility>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
 #include <boost/thread.hpp>
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
@@ -19,6 +25,30 @@ distribution for more information.
 namespace phoenix
 {
 
+//! Garbage collection modes.
+enum E_GC_MODE
+{
+	GC_POLL = 0, //!< The thread wakes up every getSleepTime() milliseconds and collects getCollectionRate() (or more) objects.
+	GC_EPOCH = 1 //!< The thread only wakes up when objects are dropped, collects all of them, and frees them once no reader can see them.
+};
+
+//! Garbage collection statistics.
+/*!
+	\sa AbstractGarbageCollector::getStats()
+*/
+struct GarbageCollectorStats
+{
+	GarbageCollectorStats()
+		: backlog(0), collected(0), time(0.0), last_collected(0), last_time(0.0)
+	{}
+
+	unsigned int backlog; //!< Number of objects still waiting to be collected after the last clean().
+	unsigned int collected; //!< Total number of objects collected.
+	double time; //!< Total time spent in clean() (in seconds).
+	unsigned int last_collected; //!< Number of objects collected by the last clean().
+	double last_time; //!< Time spent in the last clean() (in seconds).
+};
+
 //! Abstract Garbage Collector.
 /*!
 	The class eases the chore of creating threaded incremental garbage collectors. It provides a (relatively)
@@ -29,7 +59,21 @@ namespace phoenix
 	garbage collector should periodically come by and lock the list of objects and remove some (or all) of the objects
 	that are in the recycle list. This class provides the utility of periodically calling the function to delete objects
 	in the recycle list. It does not provide the recycle list, or does it provide the function that actually removes
-	the objects- this is up to the object list manager.
+	the objects- this is up to the object list manager. Object list managers should use a RecycleQueue as their
+	recycle list, so that dropping an object never has to wait for the list's mutex.
+
+	In GC_EPOCH mode, the collector also provides epoch-based reclamation. Readers (anything that iterates
+	the object list) hold an EpochGuard while iterating. Object list managers retire() objects after
+	unlinking them instead of releasing them right away, and the last reference is only released once
+	every reader that could still have seen the object has left. The thread is woken by notify() instead
+	of polling. Only readers that don't already exclude clean() need this: BatchRenderer::draw() holds the
+	graph lock that removal takes exclusively, so GC_EPOCH mostly matters for ResourceManager readers, like
+	find(), that iterate the list without waiting on the collector.
+
+	Nothing in the library calls start(). RenderSystem::run() calls clean() on its ResourceManager and
+	BatchRenderer every frame, which collects and reclaims in either mode. Call start() to also have the
+	thread collect as soon as objects are dropped.
+	\sa RecycleQueue, E_GC_MODE
 */
 class AbstractGarbageCollector
     : boost::noncopyable
@@ -43,18 +87,47 @@ public:
 		\sa setGarbageCollectionFunction()
 	*/
 	AbstractGarbageCollector( boost::function< void() > _f = boost::function< void() >() )
-		: gc_thread(), gc_mutex(), gc_param_mutex(), gc_sleep_time( 50 ), gc_collect_rate( 10 )
+		: gc_thread(), gc_mutex(), gc_param_mutex(), gc_sleep_time( 50 ), gc_collect_rate( 10 ), gc_mode( GC_POLL ), gc_stats(),
+		gc_wake_mutex(), gc_wake_cond(), gc_wake( false ), gc_epoch( 0 ), gc_limbo(), gc_limbo_pending( false )
 	{
+		gc_readers[0] = 0;
+		gc_readers[1] = 0;
 	}
 
 	/*!
 		Stops the thread.
         \note If the garbage collection thread accesses derived members, you should reset the function first!
+		Derived classes should also call stop() and then reclaimAll() in their own destructor, retired objects
+		may still reference the derived class's members.
 	*/
 	virtual ~AbstractGarbageCollector(){
 		stop();
 	}
 
+	//! Epoch Guard
+	/*!
+		Marks the current thread as a reader of the collector's object list for as long as it exists.
+		Objects retired while a guard is alive are not released until it is destroyed. Guards are cheap
+		(two atomic operations) and may be nested.
+	*/
+	class EpochGuard
+		: boost::noncopyable
+	{
+	public:
+		EpochGuard( AbstractGarbageCollector& _gc )
+			: gc( _gc ), slot( _gc.enterEpoch() )
+		{}
+
+		~EpochGuard()
+		{
+			gc.leaveEpoch( slot );
+		}
+
+	private:
+		AbstractGarbageCollector& gc;
+		unsigned int slot;
+	};
+
     //! Start Garbage Collecting
     inline virtual void start() { 
         gc_thread = boost::thread( boost::bind( &AbstractGarbageCollector::gcThreadMain, this ) ); 
@@ -103,6 +176,74 @@ public:
     */
     virtual void clean() = 0;
 
+    //! Time-budgeted clean function.
+    /*!
+        Collects as many objects as can be collected in the given time (in seconds, measured with
+        a monotonic clock) instead of a fixed number. At least getCollectionRate() objects are collected
+        even if the budget is zero or less, so frames that run over budget don't starve the collector.
+        Derived classes should overload this, the default just calls clean().
+        \sa gcClock()
+    */
+    virtual void clean( double /*_budget*/ ) { clean(); }
+
+	//! Get garbage collection statistics.
+	GarbageCollectorStats getStats(){
+		boost::mutex::scoped_lock l( gc_param_mutex );
+		return gc_stats;
+	}
+
+	//! Set the garbage collection mode.
+	/*!
+		\sa E_GC_MODE
+	*/
+	void setMode( E_GC_MODE _m ){
+		{
+			boost::mutex::scoped_lock l( gc_param_mutex );
+			gc_mode = _m;
+		}
+		notify();
+	}
+
+	//! Get the garbage collection mode.
+	E_GC_MODE getMode(){
+		boost::mutex::scoped_lock l( gc_param_mutex );
+		return gc_mode;
+	}
+
+	//! Enter the current epoch as a reader.
+	/*!
+		Prefer EpochGuard to calling this directly.
+		\return A slot that must be passed to leaveEpoch().
+	*/
+	unsigned int enterEpoch(){
+		while( true ){
+			unsigned int e = gc_epoch.load();
+			gc_readers[ e & 1 ].fetch_add( 1 );
+			// If the epoch advanced while we registered, we may have registered in a slot the collector already considers empty.
+			if( gc_epoch.load() == e ) return e & 1;
+			gc_readers[ e & 1 ].fetch_sub( 1 );
+		}
+	}
+
+	//! Leave an epoch entered with enterEpoch().
+	void leaveEpoch( unsigned int _slot ){
+		if( gc_readers[ _slot ].fetch_sub( 1 ) == 1 && gc_limbo_pending.load() ) notify();
+	}
+
+	//! Get the current epoch.
+	unsigned int getEpoch() const { return gc_epoch.load(); }
+
+	//! Wake the garbage collection thread.
+	/*!
+		Object list managers call this when they add an object to their recycle list. In GC_POLL mode it does nothing useful.
+	*/
+	void notify(){
+		if( ! gc_wake.exchange( true ) ){
+			boost::mutex::scoped_lock l( gc_wake_mutex );
+			gc_wake_cond.notify_one();
+		}
+	}
+
 	//! Get Sleep Time.
 	unsigned int getSleepTime(){
 		boost::mutex::scoped_lock( gc_param_mutex );
@@ -127,6 +268,69 @@ public:
 		gc_collect_rate = _r;
 	}
 
+protected:
+
+	//! Monotonic clock in seconds, for clean() budgets.
+	static double gcClock(){
+		return boost::chrono::duration< double >( boost::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	//! Record statistics for a clean() call.
+	void recordClean( unsigned int _collected, double _time, unsigned int _backlog ){
+		boost::mutex::scoped_lock l( gc_param_mutex );
+		gc_stats.backlog = _backlog;
+		gc_stats.collected += _collected;
+		gc_stats.time += _time;
+		gc_stats.last_collected = _collected;
+		gc_stats.last_time = _time;
+	}
+
+	//! Retire an object.
+	/*!
+		In GC_EPOCH mode, keeps a reference to an object that was just unlinked from the object list until no
+		reader can still see it. In GC_POLL mode the reference is simply released. Must be called with the
+		collector's mutex held (from clean()).
+	*/
+	void retire( DroppablePtr _d ){
+		if( getMode() == GC_EPOCH ){
+			gc_limbo.push_back( std::make_pair( gc_epoch.load(), _d ) );
+			gc_limbo_pending = true;
+		}
+	}
+
+	//! Reclaim retired objects.
+	/*!
+		Advances the epoch as far as the readers allow (at most twice, which is enough for everything retired so far),
+		and releases the objects that were retired two or more epochs ago. Without readers, everything retired by
+		this clean() is released right away. Must be called with the collector's mutex held (at the end of clean()).
+	*/
+	void reclaim(){
+		if( gc_limbo.empty() ) return;
+
+		unsigned int e = gc_epoch.load();
+		for( unsigned int n = 0; n < 2 && e - gc_limbo.front().first < 2; ++n ){
+			if( gc_readers[ ( e + 1 ) & 1 ].load() != 0 ) break;
+			gc_epoch.compare_exchange_strong( e, e + 1 );
+			e = gc_epoch.load();
+		}
+
+		std::vector< std::pair< unsigned int, DroppablePtr > >::iterator keep = gc_limbo.begin();
+		while( keep != gc_limbo.end() && e - keep->first >= 2 ) ++keep;
+		gc_limbo.erase( gc_limbo.begin(), keep );
+		gc_limbo_pending = ! gc_limbo.empty();
+	}
+
+	//! Reclaim every retired object.
+	/*!
+		Releases everything in limbo regardless of readers. Derived classes call this from their destructor,
+		after stop(), while the members the retired objects may reference still exist.
+	*/
+	void reclaimAll(){
+		boost::recursive_mutex::scoped_lock l( gc_mutex );
+		gc_limbo.clear();
+		gc_limbo_pending = false;
+	}
+
 
 private:
 
@@ -154,6 +358,46 @@ private:
 	*/
 	unsigned int gc_collect_rate;
 
+	//! Collection mode.
+	E_GC_MODE gc_mode;
+
+	//! Statistics.
+	GarbageCollectorStats gc_stats;
+
+	//! Wakeup mutex, condition, and flag for GC_EPOCH mode.
+	boost::mutex gc_wake_mutex;
+	boost::condition_variable gc_wake_cond;
+	boost::atomic< bool > gc_wake;
+
+	//! Current epoch.
+	boost::atomic< unsigned int > gc_epoch;
+
+	//! Number of readers in even and odd epochs.
+	boost::atomic< unsigned int > gc_readers[2];
+
+	//! Retired objects and the epoch they were retired in (oldest first).
+	std::vector< std::pair< unsigned int, DroppablePtr > > gc_limbo;
+
+	//! True if there are retired objects waiting for readers to leave.
+	boost::atomic< bool > gc_limbo_pending;
+
+	//! Waits until notify() is called (GC_EPOCH mode).
+	/*!
+		If retired objects are waiting, also wakes up after getSleepTime() to try advancing the epoch again.
+	*/
+	void waitForWork()
+	{
+		boost::mutex::scoped_lock l( gc_wake_mutex );
+		while( ! gc_wake.exchange( false ) )
+		{
+			if( gc_limbo_pending.load() ){
+				if( ! gc_wake_cond.timed_wait( l, boost::posix_time::milliseconds( getSleepTime() ) ) ) return;
+			} else {
+				gc_wake_cond.wait( l );
+			}
+		}
+	}
+
 	//! Garbage Collection Thread.
 	/*!
 		This is fairly simple, but fairly robust thread. It sleeps for gc_sleep_time, then
@@ -168,8 +412,11 @@ private:
 			while(1)
 			{
 
-				//sleep
-				boost::this_thread::sleep( boost::posix_time::milliseconds( getSleepTime() ) );
+				//sleep, or wait to be notified
+				if( getMode() == GC_EPOCH )
+					waitForWork();
+				else
+					boost::this_thread::sleep( boost::posix_time::milliseconds( getSleepTime() ) );
 
 			    //clean
 				clean();
@@ -12,11 +12,14 @@ distribution for more information.
 #define __PHBATCHGEOMETRY_H__
 
 #include <vector>
+#include <algorithm>
 #include "config.h"
 #include "Vertex.h"
+#include "VertexKernels.h"
 #include "Texture.h"
 #include "Rectangle.h"
 #include "TrackingInvariant.h"
+#include "BlendMode.h"
 #include "BatchRenderer.h"
 #include "Droppable.h"
 #include <boost/foreach.hpp>
@@ -42,7 +45,7 @@ typedef boost::intrusive_ptr<BatchGeometry> BatchGeometryPtr;
 	Users are able to overload this class and highly customize it. This class
 	is garbage collected and managed in very similar manner to Resource, but
 	it should be noted that they are only alike in that they are both Droppable().
-	Geometry is organized in the BatchRenderer by depth, group, texture id, and primitive type. 
+	Geometry is organized in the BatchRenderer by depth, group, blend mode, texture id, and primitive type. 
 	Any changes to any of these properties must be followed by an update() call.
 */
 class BatchGeometry
@@ -60,7 +63,7 @@ public:
 		\param _d The depth.
     */
 	BatchGeometry(BatchRenderer& _r, unsigned int _p = GL_QUADS, TexturePtr _t = TexturePtr(), signed int _g = 0, float _d = 0.0f )
-		: Droppable(), renderer(_r), primitivetype(_p), textureid( _t ? _t->getTextureId() : 0 ), texture(_t), groupid(_g), depth(_d), enabled(true), vertices(), immediate(false), clip(false)
+		: Droppable(), renderer(_r), primitivetype(_p), textureid( _t ? _t->getTextureId() : 0 ), texture(_t), groupid(_g), depth(_d), blendmode(0), enabled(true), vertices(), immediate(false), clip(false), clip_rect(), deferred(false), transform_position(0,0), transform_rotation(), transform_scale(1.0f,1.0f), transformed(), transform_dirty(true)
 	{
 		_r.add( this );
 	}
@@ -70,7 +73,7 @@ public:
 		Exactly like the regular constructor but also calls fromRectangle().
 	*/
 	BatchGeometry( BatchRenderer& _r, const Rectangle& _rect, TexturePtr _t = TexturePtr(), signed int _g = 0, float _d = 0.0f )
-        : Droppable(), renderer(_r), primitivetype( GL_QUADS ), textureid( _t ? _t->getTextureId() : 0 ), texture(_t), groupid(_g), depth(_d), enabled(true), vertices(), immediate(false), clip(false)
+        : Droppable(), renderer(_r), primitivetype( GL_QUADS ), textureid( _t ? _t->getTextureId() : 0 ), texture(_t), groupid(_g), depth(_d), blendmode(0), enabled(true), vertices(), immediate(false), clip(false), clip_rect(), deferred(false), transform_position(0,0), transform_rotation(), transform_scale(1.0f,1.0f), transformed(), transform_dirty(true)
 	{
 		fromRectangle( _rect );
 		_r.add( this );
@@ -81,7 +84,7 @@ public:
 		Exactly like the regular constructor but also calls fromPolygon().
 	*/
 	BatchGeometry( BatchRenderer& _r, const Polygon& _poly, TexturePtr _t = TexturePtr(), signed int _g = 0, float _d = 0.0f )
-        : Droppable(), renderer(_r), primitivetype( GL_TRIANGLES ), textureid( _t ? _t->getTextureId() : 0 ), texture(_t), groupid(_g), depth(_d), enabled(true), vertices(), immediate(false), clip(false)
+        : Droppable(), renderer(_r), primitivetype( GL_TRIANGLES ), textureid( _t ? _t->getTextureId() : 0 ), texture(_t), groupid(_g), depth(_d), blendmode(0), enabled(true), vertices(), immediate(false), clip(false), clip_rect(), deferred(false), transform_position(0,0), transform_rotation(), transform_scale(1.0f,1.0f), transformed(), transform_dirty(true)
 	{
         fromPolygon( _poly );
 		_r.add( this );
@@ -121,11 +124,8 @@ public:
 	*/
 	inline virtual void drop()
 	{
-		if( ! dropped() )
-		{
+		if( exchangeDropped() )
 			renderer.remove( this );
-			Droppable::drop();
-		}
 	}
 
 	//! Get vertex
@@ -144,6 +144,7 @@ public:
     inline void setVertex(const signed int& a, const Vertex& v)
     {
         vertices[ a % vertices.size() ] = v;
+        transform_dirty = true;
     }
 
 
@@ -151,10 +152,14 @@ public:
     inline void addVertex(const Vertex& a)
     {
         vertices.push_back(a);
+        transform_dirty = true;
     }
 
+	//! Reserve storage for the given number of vertices.
+	inline void reserve( unsigned int _n ) { vertices.reserve( _n ); }
+
 	//! Clear all vertices
-	inline void clear() { vertices.clear(); }
+	inline void clear() { vertices.clear(); transform_dirty = true; }
 
 	//! Remove vertex.
 	/*!
@@ -163,6 +168,7 @@ public:
 	inline void removeVertex( const signed int& a )
 	{
 		vertices.erase( vertices.begin() + (a % vertices.size()) );
+		transform_dirty = true;
 	}
 
 	//! The current number of vertices in the geometry.
@@ -172,7 +178,10 @@ public:
     }
 
 	//! Array operator for vertices. (operates as a ring buffer).
-	inline Vertex& operator[] ( signed int _i ) { return vertices[ _i % vertices.size() ]; }
+	/*!
+		\note If a deferred transform is used, this is a local-space vertex.
+	*/
+	inline Vertex& operator[] ( signed int _i ) { transform_dirty = true; return vertices[ _i % vertices.size() ]; }
 
 	//! Returns the invariant for the Primitive Type (used by BatchRender).
 	inline TrackingInvariant< unsigned int >& getPrimitiveTypeInvariant() { return primitivetype; }
@@ -186,6 +195,9 @@ public:
 	//! Returns the invariant for the Depth (used by BatchRender).
 	inline TrackingInvariant< float >& getDepthInvariant() { return depth; }
 
+	//! Returns the invariant for the Blend Mode key (used by BatchRender).
+	inline TrackingInvariant< unsigned int >& getBlendModeInvariant() { return blendmode; }
+
 	//! Get the texture associated with this geometry.
 	inline TexturePtr getTexture() { return texture; }
 
@@ -201,6 +213,9 @@ public:
 	//! Get the Depth associated with this geometry.
 	inline float getDepth() const { return depth; }
 
+	//! Get the Blend Mode of this geometry.
+	inline BlendMode getBlendMode() const { return BlendMode::fromKey( blendmode ); }
+
 	//! Check if this geometry is enabled.
 	inline bool getEnabled() const { return enabled; }
 
@@ -246,6 +261,16 @@ public:
 	*/
 	inline virtual void setDepth( float _v ) { depth = _v; }
 
+	//! Set Blend Mode
+	/*!
+		Sets the blend mode this geometry is drawn with. Within a group, geometry is sorted by blend mode, so
+		all the additive geometry of a group at a depth is drawn with a single blend state change. The default
+		is BlendMode::Inherit(), which uses the current blend function.
+		\see getBlendMode(), update(), BlendMode
+		\note update() must be called before this change will take effect!
+	*/
+	inline virtual void setBlendMode( const BlendMode& _b ) { blendmode = _b.getKey(); }
+
 	//! Enable or Disable.
 	/*!
 		Disabled geometry is skipped over during rendering.
@@ -275,21 +300,57 @@ public:
 	//! Get the Clipping Rectangle
 	inline const Rectangle& getClippingRectangle() { return clip_rect; }
 
+	//! Enable or disable the deferred transform.
+	/*!
+		When enabled, the vertices of this geometry are treated as local-space vertices and the
+		transform set by setPosition(), setRotation() and setScale() is applied to them when the
+		geometry is batched (scale first, then rotation, then translation). The transformed
+		vertices are cached and only recomputed when the transform or the vertices change, so
+		moving geometry only costs a few floats instead of rewriting every vertex.
+		\sa setPosition(), setRotation(), setScale()
+	*/
+	inline virtual void setDeferredTransform( bool _d ) { deferred = _d; transform_dirty = true; }
+
+	//! Check if this geometry uses a deferred transform.
+	inline bool getDeferredTransform() const { return deferred; }
+
+	//! Set the position of the deferred transform.
+	inline virtual void setPosition( const Vector2d& _p ) { transform_position = _p; transform_dirty = true; }
+
+	//! Get the position of the deferred transform.
+	inline const Vector2d& getPosition() const { return transform_position; }
+
+	//! Set the rotation of the deferred transform.
+	inline virtual void setRotation( const RotationMatrix& _m ) { transform_rotation = _m; transform_dirty = true; }
+
+	//! Set the rotation of the deferred transform in radians.
+	inline void setRotation( float _r ) { setRotation( RotationMatrix( _r ) ); }
+
+	//! Get the rotation of the deferred transform.
+	inline const RotationMatrix& getRotation() const { return transform_rotation; }
+
+	//! Set the scale of the deferred transform.
+	inline virtual void setScale( const Vector2d& _s ) { transform_scale = _s; transform_dirty = true; }
+
+	//! Get the scale of the deferred transform.
+	inline const Vector2d& getScale() const { return transform_scale; }
+
 	//! Update
 	/*!
 		This function will check all invariants and move the geometry's location in the renderer's graph
 		if any of them have been broken, and then resets all the invariants. This function should be called
-		after the depth, group, texture, or primitive type of this geometry is changed.
+		after the depth, group, blend mode, texture, or primitive type of this geometry is changed.
 	*/
 	virtual void update()
 	{
-		if( ! (primitivetype.check() && textureid.check() && groupid.check() && depth.check()) )
+		if( ! (primitivetype.check() && textureid.check() && groupid.check() && depth.check() && blendmode.check()) )
 		{
 			renderer.move( this );
 			primitivetype.reset();
 			textureid.reset();
 			groupid.reset();
 			depth.reset();
+			blendmode.reset();
 		}
 	}
 
@@ -310,28 +371,83 @@ public:
 
 		if( enabled )
 		{
-			if( ! vertices.empty() )
+			const std::vector<Vertex>& source = getTransformedVertices();
+			if( ! source.empty() )
 			{
-                std::vector<Vertex>::iterator verticesend = vertices.end();
-                for( std::vector<Vertex>::iterator v = vertices.begin(); v != verticesend; ++v )
-					list.push_back( *v );
+				list.insert( list.end(), source.begin(), source.end() );
 			}
 			return 1;
 		}
 		return 0;
 	}
 
+	//! Value returned by getBatchSize() for geometry that can only be batched with batch( std::vector<Vertex>&, bool ).
+	static const unsigned int BATCH_UNSIZED = 0xFFFFFFFF;
+
+	//! Batch size
+	/*!
+		Returns the number of vertices batch( Vertex*, bool ) will write, or BATCH_UNSIZED if the
+		renderer must use batch( std::vector<Vertex>&, bool ) instead.
+		\sa supportsDirectBatch()
+	*/
+	virtual unsigned int getBatchSize()
+	{
+		if( ! supportsDirectBatch() ) return BATCH_UNSIZED;
+		return enabled ? getTransformedVertices().size() : 0;
+	}
+
+	//! Batch directly
+	/*!
+		This function is called by BatchRenderer when it draws the current render graph
+		and getBatchSize() did not return BATCH_UNSIZED. The geometry writes its vertices
+		directly to the given destination, which has room for getBatchSize() vertices.
+		\param dst Where to write the vertices.
+		\param persist If true, immediate geometry will not drop itself.
+		\return The number of vertices written.
+	*/
+	virtual unsigned int batch( Vertex* dst, bool persist = false )
+	{
+		if( immediate && !persist )
+		{
+			drop();
+		}
+
+		if( enabled )
+		{
+			const std::vector<Vertex>& source = getTransformedVertices();
+			std::copy( source.begin(), source.end(), dst );
+			return source.size();
+		}
+		return 0;
+	}
+
 	//! Combine with another
 	/*
 		Combines this geometry with another geometry by pushing the vertices of 
 		the other onto this one. This function does not perform any checks. It
-		assume you know what you're doing. 
+		assume you know what you're doing. The other geometry's vertices are taken
+		as they would be drawn. If this geometry uses a deferred transform, they are
+		brought into its local space so they are not transformed twice (a scale of
+		zero can't be undone, so they are then left as they are).
 		\sa BatchGeometryComposite::combine
 	*/
 	virtual void combine( const BatchGeometryPtr& other, bool dropOther = true ) {
-		vertices.reserve(vertices.size() + other->vertices.size());
-		BOOST_FOREACH( Vertex& v, other->vertices ) {
-			vertices.push_back( v );
+		const std::vector<Vertex>& source = other->getTransformedVertices();
+		const std::size_t first = vertices.size();
+		vertices.insert( vertices.end(), source.begin(), source.end() );
+		transform_dirty = true;
+
+		if( deferred && vertices.size() > first ) {
+			// Inverse of the deferred transform: translate back, then undo the rotation and scale.
+			const float m0 = transform_rotation.getElement(0) * transform_scale.getX();
+			const float m1 = transform_rotation.getElement(1) * transform_scale.getY();
+			const float m2 = transform_rotation.getElement(2) * transform_scale.getX();
+			const float m3 = transform_rotation.getElement(3) * transform_scale.getY();
+			const float det = m0 * m3 - m1 * m2;
+			if( det != 0.0f ) {
+				TranslateVertices( &vertices[first], vertices.size() - first, transform_position * -1.0f );
+				RotateVertices( &vertices[first], vertices.size() - first, RotationMatrix( m3 / det, -m1 / det, -m2 / det, m0 / det ) );
+			}
 		}
 
 		if( dropOther ) {
@@ -346,10 +462,8 @@ public:
 	*/
 	inline virtual void translate( const Vector2d& _t )
 	{
-		BOOST_FOREACH( Vertex& v, vertices )
-		{
-			v.position += _t;
-		}
+		if( ! vertices.empty() ) TranslateVertices( &vertices[0], vertices.size(), _t );
+		transform_dirty = true;
 	}
 
 	//! Scale
@@ -359,11 +473,8 @@ public:
 	*/
 	inline virtual void scale( const Vector2d& _s )
 	{
-		BOOST_FOREACH( Vertex& v, vertices )
-		{
-			v.position.setX( v.position.getX() * _s.getX() );
-			v.position.setY( v.position.getY() * _s.getY() );
-		}
+		if( ! vertices.empty() ) ScaleVertices( &vertices[0], vertices.size(), _s );
+		transform_dirty = true;
 	}
 
 	//! Rotate
@@ -373,19 +484,27 @@ public:
 	*/
 	inline virtual void rotate( const RotationMatrix& _m )
 	{
-		BOOST_FOREACH( Vertex& v, vertices )
-		{
-			v.position *= _m;
-		}
+		if( ! vertices.empty() ) RotateVertices( &vertices[0], vertices.size(), _m );
+		transform_dirty = true;
+	}
+
+	//! Transform
+	/*!
+		Multiplies each vertex by the given matrix and then translates it, in a single pass.
+		This is equivalent to (but faster than) calling rotate() and then translate().
+		\f$ v_n = v_n * m + t \f$
+	*/
+	inline virtual void transform( const RotationMatrix& _m, const Vector2d& _t )
+	{
+		if( ! vertices.empty() ) TransformVertices( &vertices[0], &vertices[0], vertices.size(), _m, _t );
+		transform_dirty = true;
 	}
 
 	//! Sets the color on all vertices.
 	inline virtual void colorize( const Color& _c )
 	{
-		BOOST_FOREACH( Vertex& v, vertices )
-		{
-			v.color = _c;
-		}
+		if( ! vertices.empty() ) ColorizeVertices( &vertices[0], vertices.size(), _c );
+		transform_dirty = true;
 	}
 
 	//! Define vertices using a Polygon.
@@ -408,6 +527,7 @@ public:
                 vertices.push_back( rhs.getPosition() );
 			}
 		}
+		transform_dirty = true;
 	}
 
 	//! Define vertices using a Rectangle.
@@ -430,6 +550,17 @@ public:
 
 protected:
 
+	//! Direct batch support
+	/*!
+		Returns true if batch( Vertex*, bool ) writes the same vertices as batch( std::vector<Vertex>&, bool ).
+		Subclasses that override batch( std::vector<Vertex>&, bool ) to produce custom vertices (and not
+		batch( Vertex*, bool ) as well) must return false, so the renderer keeps calling their override.
+	*/
+	virtual bool supportsDirectBatch() const
+	{
+		return true;
+	}
+
 	//! Renderer
 	BatchRenderer& renderer;
 
@@ -455,6 +586,12 @@ protected:
 	//! Depth
 	TrackingInvariant< float > depth;
 
+	//! Blend Mode
+	/*
+		The key of the blend mode ( BlendMode::getKey() ), 0 if it's inherited.
+	*/
+	TrackingInvariant< unsigned int > blendmode;
+
 	//! Enabled
 	bool enabled;
 
@@ -472,6 +609,53 @@ protected:
 
 	//! Clip rectangle
 	Rectangle clip_rect;
+
+	//! Deferred transform
+	/*
+		If true, the vertices are in local space and the transform below is applied when batching.
+	*/
+	bool deferred;
+
+	//! Deferred transform position.
+	Vector2d transform_position;
+
+	//! Deferred transform rotation.
+	RotationMatrix transform_rotation;
+
+	//! Deferred transform scale.
+	Vector2d transform_scale;
+
+	//! Cached transformed vertices.
+	std::vector< Vertex > transformed;
+
+	//! True if the cached transformed vertices must be recomputed.
+	bool transform_dirty;
+
+	//! Vertices to batch.
+	/*!
+		Returns the local vertices if there is no deferred transform, otherwise returns the
+		cached transformed vertices, recomputing them first if the transform or the vertices changed.
+		The scale is folded into the rotation matrix so this is a single pass over the vertices.
+	*/
+	inline const std::vector< Vertex >& getTransformedVertices()
+	{
+		if( ! deferred ) return vertices;
+		if( transform_dirty )
+		{
+			transformed.resize( vertices.size() );
+			if( ! vertices.empty() )
+			{
+				RotationMatrix m( transform_rotation );
+				m[0] *= transform_scale.getX();
+				m[1] *= transform_scale.getY();
+				m[2] *= transform_scale.getX();
+				m[3] *= transform_scale.getY();
+				TransformVertices( &transformed[0], &vertices[0], vertices.size(), m, transform_position );
+			}
+			transform_dirty = false;
+		}
+		return transformed;
+	}
 };
 
 } //namespace phoniex
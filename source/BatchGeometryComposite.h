@@ -120,6 +120,18 @@ public:
 		}
 	}
 
+	//! Set Blend Mode
+	/*!
+		Affects all children
+	*/
+	inline virtual void setBlendMode( const BlendMode& _b )
+	{ 
+		BatchGeometry::setBlendMode(_b);
+		BOOST_FOREACH( BatchGeometryPtr& g, geoms ){
+			g->setBlendMode(_b);
+		}
+	}
+
 	//! Enable or Disable.
 	/*!
 		Affects all children
@@ -169,6 +181,29 @@ public:
 		return 0;
 	}
 
+	//! Batch size
+	/*!
+		Always zero, the children are batched on their own.
+	*/
+	virtual unsigned int getBatchSize()
+	{
+		if( ! supportsDirectBatch() ) return BATCH_UNSIZED;
+		return 0;
+	}
+
+	//! Batch directly
+	/*!
+		Does nothing except the immediate check.
+	*/
+	virtual unsigned int batch( Vertex*, bool persist = false )
+	{
+		if( immediate && !persist )
+		{
+			drop(true);
+		}
+		return 0;
+	}
+
 	//! Overridden Combine
 	/*!
 		Does nothing, but may drop the other geometry
@@ -239,6 +274,56 @@ public:
 		}
 	}
 
+	//! Transform
+	/*!
+		Affects all children
+	*/
+	inline virtual void transform( const RotationMatrix& _m, const Vector2d& _t )
+	{ 
+		BatchGeometry::transform(_m, _t);
+		BOOST_FOREACH( BatchGeometryPtr& g, geoms ){
+			g->transform(_m, _t);
+		}
+	}
+
+	//! Enables/disables the deferred transform. Affects all children.
+	inline virtual void setDeferredTransform( bool _d )
+	{ 
+		BatchGeometry::setDeferredTransform(_d);
+		BOOST_FOREACH( BatchGeometryPtr& g, geoms ){
+			g->setDeferredTransform(_d);
+		}
+	}
+
+	//! Sets the deferred transform position. Affects all children.
+	inline virtual void setPosition( const Vector2d& _p )
+	{ 
+		BatchGeometry::setPosition(_p);
+		BOOST_FOREACH( BatchGeometryPtr& g, geoms ){
+			g->setPosition(_p);
+		}
+	}
+
+	using BatchGeometry::setRotation;
+
+	//! Sets the deferred transform rotation. Affects all children.
+	inline virtual void setRotation( const RotationMatrix& _m )
+	{ 
+		BatchGeometry::setRotation(_m);
+		BOOST_FOREACH( BatchGeometryPtr& g, geoms ){
+			g->setRotation(_m);
+		}
+	}
+
+	//! Sets the deferred transform scale. Affects all children.
+	inline virtual void setScale( const Vector2d& _s )
+	{ 
+		BatchGeometry::setScale(_s);
+		BOOST_FOREACH( BatchGeometryPtr& g, geoms ){
+			g->setScale(_s);
+		}
+	}
+
 	//! Sets the color on all vertices. Affects all children
 	inline virtual void colorize( const Color& _c )
 	{ 
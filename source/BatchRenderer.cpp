@@ -19,22 +19,27 @@ using namespace std;
 //! Lists all the geometry in the list.
 void BatchRenderer::listGeometry()
 {
+	boost::shared_lock< boost::shared_mutex > l( graph_mutex );
 	BOOST_FOREACH( BATCHMAPDELTA::value_type& deltapair, geometry ){
 		BOOST_FOREACH( BATCHMAPGAMMA::value_type& gammapair, deltapair.second ){
-			BOOST_FOREACH( BATCHMAPBETA::value_type& betapair, gammapair.second ){
-				BOOST_FOREACH( BATCHMAPALPHA::value_type& alphapair, betapair.second ){
-					BOOST_FOREACH( intrusive_ptr<BatchGeometry>& geom, alphapair.second )
-					{
-						std::cout<<"\n Geometry "<<geom.get()
-							<<" at "
-							<<deltapair.first
-							<<", "<<gammapair.first
-							<<", "<<betapair.first
-							<<", "<<alphapair.first
-							<<" with properties "<<geom->getDepth()
-							<<", "<<geom->getGroup()
-							<<", "<<geom->getTextureId()
-							<<", "<<geom->getPrimitiveType();
+			BOOST_FOREACH( BATCHMAPBLEND::value_type& blendpair, gammapair.second ){
+				BOOST_FOREACH( BATCHMAPBETA::value_type& betapair, blendpair.second ){
+					BOOST_FOREACH( BATCHMAPALPHA::value_type& alphapair, betapair.second ){
+						BOOST_FOREACH( intrusive_ptr<BatchGeometry>& geom, alphapair.second )
+						{
+							std::cout<<"\n Geometry "<<geom.get()
+								<<" at "
+								<<deltapair.first
+								<<", "<<gammapair.first
+								<<", "<<blendpair.first
+								<<", "<<betapair.first
+								<<", "<<alphapair.first
+								<<" with properties "<<geom->getDepth()
+								<<", "<<geom->getGroup()
+								<<", "<<geom->getBlendModeInvariant().get()
+								<<", "<<geom->getTextureId()
+								<<", "<<geom->getPrimitiveType();
+						}
 					}
 				}
 			}
@@ -45,13 +50,16 @@ void BatchRenderer::listGeometry()
 
 unsigned int BatchRenderer::count()
 {
-	boost::recursive_mutex::scoped_lock l( getMutex() );
+	sync();
+	boost::shared_lock< boost::shared_mutex > l( graph_mutex );
 	unsigned int total = 0;
 	BOOST_FOREACH( BATCHMAPDELTA::value_type& deltapair, geometry ){
 		BOOST_FOREACH( BATCHMAPGAMMA::value_type& gammapair, deltapair.second ){
-			BOOST_FOREACH( BATCHMAPBETA::value_type& betapair, gammapair.second ){
-				BOOST_FOREACH( BATCHMAPALPHA::value_type& alphapair, betapair.second ){
-					total += alphapair.second.size();
+			BOOST_FOREACH( BATCHMAPBLEND::value_type& blendpair, gammapair.second ){
+				BOOST_FOREACH( BATCHMAPBETA::value_type& betapair, blendpair.second ){
+					BOOST_FOREACH( BATCHMAPALPHA::value_type& alphapair, betapair.second ){
+						total += alphapair.second.size();
+					}
 				}
 			}
 		}
@@ -62,91 +70,486 @@ unsigned int BatchRenderer::count()
 
 void BatchRenderer::add( boost::intrusive_ptr<BatchGeometry> _g )
 {
-	boost::recursive_mutex::scoped_lock l( getMutex() );
-	geometry[_g->getDepth()][ _g->getGroup() ][ _g->getTextureId() ][_g->getPrimitiveType()].push_back( _g );
+	if( CommandBuffer* cb = getCommandBuffer() )
+	{
+		Command c;
+		c.type = Command::ADD;
+		c.geom = _g;
+		c.to = keyOf( _g );
+		cb->recording.push_back( c );
+		return;
+	}
+
+	// Queue it for the next sync(), this never waits on draw().
+	Command c;
+	c.type = Command::ADD;
+	c.geom = _g;
+	c.to = keyOf( _g );
+	queueCommand( c );
 }
 
 void BatchRenderer::remove( boost::intrusive_ptr<BatchGeometry> _g )
 {
-	boost::recursive_mutex::scoped_lock l( getMutex() );
-	recyclelist.push_back( _g );
+	// Lock-free, this never waits on draw() or clean().
+	recyclelist.push( _g );
+	notify();
 }
 
 void BatchRenderer::removeProper( boost::intrusive_ptr<BatchGeometry> _g, bool _inv )
 {
+	removeAt( _g, keyOf( _g, _inv ) );
+}
 
-	unsigned int textureid = _g->getTextureId();
-	signed int groupid = _g->getGroup();
-	unsigned int primitivetype = _g->getPrimitiveType();
-	float depth = _g->getDepth();
+BatchRenderer::GraphKey BatchRenderer::keyOf( boost::intrusive_ptr<BatchGeometry> _g, bool _inv )
+{
+	GraphKey k;
+	k.texture = _g->getTextureId();
+	k.group = _g->getGroup();
+	k.blend = _g->getBlendModeInvariant().get();
+	k.primitive = _g->getPrimitiveType();
+	k.depth = _g->getDepth();
 
 	if( _inv == true ) {// we're using the previous value
-		groupid = _g->getGroupInvariant().getPrevious();
-		primitivetype = _g->getPrimitiveTypeInvariant().getPrevious();
-		depth = _g->getDepthInvariant().getPrevious();
-		textureid = _g->getTextureIdInvariant().getPrevious();
+		k.group = _g->getGroupInvariant().getPrevious();
+		k.blend = _g->getBlendModeInvariant().getPrevious();
+		k.primitive = _g->getPrimitiveTypeInvariant().getPrevious();
+		k.depth = _g->getDepthInvariant().getPrevious();
+		k.texture = _g->getTextureIdInvariant().getPrevious();
 	}
 
-	//lock the mutex
-	boost::recursive_mutex::scoped_lock l( getMutex() );
+	return k;
+}
 
-	GEOMCONTAINER* container = &(geometry[ depth ][ groupid ][ textureid ][ primitivetype ]);
+void BatchRenderer::insertAt( boost::intrusive_ptr<BatchGeometry> _g, const GraphKey& _k )
+{
+	geometry[ _k.depth ][ _k.group ][ _k.blend ][ _k.texture ][ _k.primitive ].push_back( _g );
+}
+
+bool BatchRenderer::removeAt( boost::intrusive_ptr<BatchGeometry> _g, const GraphKey& _k )
+{
+	GEOMCONTAINER* container = &(geometry[ _k.depth ][ _k.group ][ _k.blend ][ _k.texture ][ _k.primitive ]);
 	GEOMCONTAINER::iterator f = std::find( container->begin(), container->end(), _g );
 	if( f != container->end() )
 	{
 		// The ol' pop & swap; 
 		boost::swap( (*f) , container->back() );
 		container->pop_back();
+		return true;
+	}
+	return false;
+}
 
+void BatchRenderer::move( boost::intrusive_ptr<BatchGeometry> _g )
+{
+	if( CommandBuffer* cb = getCommandBuffer() )
+	{
+		// Keys are taken now, update() resets the invariants right after this.
+		Command c;
+		c.type = Command::MOVE;
+		c.geom = _g;
+		c.from = keyOf( _g, true );
+		c.to = keyOf( _g );
+		cb->recording.push_back( c );
+		return;
+	}
+
+	// Queue it for the next sync(), with the keys as they are now.
+	Command c;
+	c.type = Command::MOVE;
+	c.geom = _g;
+	c.from = keyOf( _g, true );
+	c.to = keyOf( _g );
+	queueCommand( c );
+}
+
+void BatchRenderer::queueCommand( const Command& _c )
+{
+	boost::mutex::scoped_lock l( pending_mutex );
+
+	boost::unordered_map< BatchGeometry*, std::size_t >::iterator i = pending_index.find( _c.geom.get() );
+	if( i != pending_index.end() && _c.type == Command::MOVE )
+	{
+		// It's already going somewhere (added or moved), just change where.
+		pending[ i->second ].to = _c.to;
 	}
 	else
 	{
-		//throw;
+		pending_index[ _c.geom.get() ] = pending.size();
+		pending.push_back( _c );
+		if( _c.type == Command::MOVE ) ++pending_moves;
 	}
+
+	needs_sync = true;
 }
 
-void BatchRenderer::move( boost::intrusive_ptr<BatchGeometry> _g )
+unsigned int BatchRenderer::getPendingMoveCount()
 {
-	lock();
-	removeProper( _g, true );
-	add( _g );
-	unlock();
+	boost::mutex::scoped_lock l( pending_mutex );
+	return pending_moves;
 }
 
+bool BatchRenderer::keyLess( const GraphKey& _a, const GraphKey& _b )
+{
+	if( _a.depth != _b.depth ) return _a.depth < _b.depth;
+	if( _a.group != _b.group ) return _a.group < _b.group;
+	if( _a.blend != _b.blend ) return _a.blend < _b.blend;
+	if( _a.texture != _b.texture ) return _a.texture < _b.texture;
+	return _a.primitive < _b.primitive;
+}
 
-void BatchRenderer::clean()
+bool BatchRenderer::keyEqual( const GraphKey& _a, const GraphKey& _b )
 {
-	
-	boost::recursive_mutex::scoped_lock l( getMutex() );
+	return _a.depth == _b.depth && _a.group == _b.group && _a.blend == _b.blend && _a.texture == _b.texture && _a.primitive == _b.primitive;
+}
+
+void BatchRenderer::applyCommands( std::vector< Command >& _c )
+{
+	std::vector< Command* > sorted;
+	sorted.reserve( _c.size() );
+
+	// Removals, one pass over each source container.
+	BOOST_FOREACH( Command& c, _c )
+	{
+		if( c.type == Command::MOVE ) sorted.push_back( &c );
+	}
+	std::sort( sorted.begin(), sorted.end(), &BatchRenderer::fromLess );
+
+	boost::unordered_set< BatchGeometry* > leaving;
+	for( std::size_t i = 0; i < sorted.size(); )
+	{
+		std::size_t j = i;
+		leaving.clear();
+		while( j < sorted.size() && keyEqual( sorted[j]->from, sorted[i]->from ) )
+		{
+			leaving.insert( sorted[j]->geom.get() );
+			++j;
+		}
+
+		const GraphKey& k = sorted[i]->from;
+		GEOMCONTAINER& container = geometry[ k.depth ][ k.group ][ k.blend ][ k.texture ][ k.primitive ];
+		for( GEOMCONTAINER::iterator g = container.begin(); g != container.end(); )
+		{
+			if( leaving.find( g->get() ) != leaving.end() ) g = container.erase( g );
+			else ++g;
+		}
+
+		i = j;
+	}
+
+	// Insertions, one lookup for each destination container. Geometry that was dropped before it was applied is never
+	// inserted, clean() won't find it but it doesn't need to.
+	sorted.clear();
+	BOOST_FOREACH( Command& c, _c )
+	{
+		if( ! c.geom->dropped() ) sorted.push_back( &c );
+	}
+	std::stable_sort( sorted.begin(), sorted.end(), &BatchRenderer::toLess );
+
+	GEOMCONTAINER* container = 0;
+	for( std::size_t i = 0; i < sorted.size(); ++i )
+	{
+		const GraphKey& k = sorted[i]->to;
+		if( ! container || ! keyEqual( k, sorted[i-1]->to ) )
+			container = &geometry[ k.depth ][ k.group ][ k.blend ][ k.texture ][ k.primitive ];
+		container->push_back( sorted[i]->geom );
+	}
+}
+
+void BatchRenderer::applyCommand( const Command& _c )
+{
+	// Geometry that was dropped before it was applied is never inserted, clean() won't find it but it doesn't need to.
+	if( _c.type == Command::MOVE ) removeAt( _c.geom, _c.from );
+	if( ! _c.geom->dropped() ) insertAt( _c.geom, _c.to );
+}
+
+void BatchRenderer::sync()
+{
+	if( ! needs_sync.exchange( false ) ) return;
+
+	boost::unique_lock< boost::shared_mutex > gl( graph_mutex );
+
+	std::vector< Command > commands;
+	{
+		boost::mutex::scoped_lock l( pending_mutex );
+		commands.swap( pending );
+		pending_index.clear();
+		pending_moves = 0;
+	}
+	applyCommands( commands );
 
+	if( threaded_submission ) mergeCommandBuffers();
+
+	prune();
+}
+
+void BatchRenderer::prune()
+{
+	for( BATCHMAPDELTA::iterator deltapair = geometry.begin(); deltapair != geometry.end(); )
+	{
+		for( BATCHMAPGAMMA::iterator gammapair = deltapair->second.begin(); gammapair != deltapair->second.end(); )
+		{
+			for( BATCHMAPBLEND::iterator blendpair = gammapair->second.begin(); blendpair != gammapair->second.end(); )
+			{
+				for( BATCHMAPBETA::iterator betapair = blendpair->second.begin(); betapair != blendpair->second.end(); )
+				{
+					for( BATCHMAPALPHA::iterator alphapair = betapair->second.begin(); alphapair != betapair->second.end(); )
+					{
+						if( alphapair->second.empty() ) alphapair = betapair->second.erase( alphapair );
+						else ++alphapair;
+					}
+					if( betapair->second.empty() ) betapair = blendpair->second.erase( betapair );
+					else ++betapair;
+				}
+				if( blendpair->second.empty() ) blendpair = gammapair->second.erase( blendpair );
+				else ++blendpair;
+			}
+			if( gammapair->second.empty() ) gammapair = deltapair->second.erase( gammapair );
+			else ++gammapair;
+		}
+		if( deltapair->second.empty() ) geometry.erase( deltapair++ );
+		else ++deltapair;
+	}
+}
+
+
+void BatchRenderer::setThreadedSubmission( bool _t )
+{
+	setRenderThread();
+	threaded_submission = _t;
+}
+
+BatchRenderer::CommandBufferHandle* BatchRenderer::getThreadHandle()
+{
+	CommandBufferHandle* h = thread_buffer.get();
+	if( ! h )
+	{
+		h = new CommandBufferHandle();
+		thread_buffer.reset( h );
+	}
+
+	if( h->generation != render_thread_generation.load( boost::memory_order_acquire ) )
+	{
+		boost::mutex::scoped_lock l( render_thread_mutex );
+		h->generation = render_thread_generation.load( boost::memory_order_relaxed );
+		h->render = boost::this_thread::get_id() == render_thread;
+	}
+	return h;
+}
+
+void BatchRenderer::setRenderThread()
+{
+	boost::mutex::scoped_lock l( render_thread_mutex );
+	if( render_thread != boost::this_thread::get_id() )
+	{
+		render_thread = boost::this_thread::get_id();
+		render_thread_generation.fetch_add( 1, boost::memory_order_release );
+	}
+}
+
+void BatchRenderer::submit()
+{
+	if( CommandBuffer* cb = getCommandBuffer() )
+	{
+		if( cb->recording.empty() ) return;
+		boost::mutex::scoped_lock l( cb->mutex );
+		cb->submitted.insert( cb->submitted.end(), cb->recording.begin(), cb->recording.end() );
+		cb->recording.clear();
+		needs_sync = true;
+	}
+}
+
+BatchRenderer::CommandBuffer* BatchRenderer::getCommandBuffer()
+{
+	if( ! threaded_submission ) return 0;
+
+	CommandBufferHandle* h = getThreadHandle();
+	if( h->render ) return 0;
+
+	if( ! h->buffer )
+	{
+		h->buffer.reset( new CommandBuffer() );
+
+		boost::mutex::scoped_lock l( command_buffers_mutex );
+		command_buffers.push_back( h->buffer );
+	}
+	return h->buffer.get();
+}
+
+void BatchRenderer::mergeCommandBuffers()
+{
+	std::vector< Command > commands;
+
+	boost::mutex::scoped_lock l( command_buffers_mutex );
+	for( std::vector< boost::shared_ptr< CommandBuffer > >::iterator b = command_buffers.begin(); b != command_buffers.end(); )
+	{
+		{
+			boost::mutex::scoped_lock bl( (*b)->mutex );
+			commands.swap( (*b)->submitted );
+		}
+
+		BOOST_FOREACH( Command& c, commands )
+		{
+			applyCommand( c );
+		}
+		commands.clear();
+
+		// Forget the buffers of threads that have exited.
+		if( b->unique() ){
+			b = command_buffers.erase( b );
+		} else {
+			++b;
+		}
+	}
+}
+
+void BatchRenderer::clean()
+{
     unsigned int multiplier = recyclelist.size()/getCollectionRate();
     if( multiplier < getCollectionRate() ) multiplier = getCollectionRate();
-	
-	for( unsigned int i = 0; i < multiplier; ++i )
+
+	// In epoch mode everything is collected, the geometry is only released once no draw() can see it.
+	collect( getMode() == GC_EPOCH ? UINT_MAX : multiplier, -1.0 );
+}
+
+void BatchRenderer::clean( double _budget )
+{
+	// Always collect a few, so a frame that runs over budget doesn't starve the collector.
+	if( _budget < 0.0 ) _budget = 0.0;
+	collect( UINT_MAX, _budget, getCollectionRate() );
+}
+
+void BatchRenderer::collect( unsigned int _max, double _budget, unsigned int _min )
+{
+	// Apply queued changes first, so the geometry is where removeProper() expects it.
+	sync();
+
+	boost::recursive_mutex::scoped_lock l( getMutex() );
+
+	const double start = gcClock();
+	unsigned int i = 0;
+
+	if( ! recyclelist.empty() )
 	{
-		if( ! recyclelist.empty() )
+		boost::unique_lock< boost::shared_mutex > gl( graph_mutex );
+	
+		boost::intrusive_ptr<BatchGeometry> g;
+		for( ; i < _max; ++i )
 		{
-			boost::intrusive_ptr<BatchGeometry>& g = recyclelist.back();
-			if( g )
-				removeProper( g );
-			recyclelist.pop_back();
+			if( _budget >= 0.0 && i >= _min && gcClock() - start >= _budget ) break;
+
+			if( recyclelist.pop( g ) )
+			{
+				if( g )
+				{
+					removeProper( g );
+					retire( g );
+				}
+			}
+			else
+			{
+				break;
+			}
 		}
-		else
-		{
-			break;
+
+		if( i ) prune();
+	}
+
+	reclaim();
+	recordClean( i, gcClock() - start, recyclelist.size() );
+}
+
+void BatchRenderer::capture( FrameCapture& _c )
+{
+	// Batching touches the geometry's transform cache, so this can't run along with draw().
+	boost::mutex::scoped_lock dl( draw_mutex );
+	EpochGuard eg( *this );
+	sync();
+
+	boost::shared_lock< boost::shared_mutex > l( graph_mutex );
+
+	_c.clear();
+	_c.view = view;
+	_c.clear_color = clear_color;
+	_c.clearing = enable_clear;
+
+	BOOST_FOREACH( GROUPSTATEMAP::value_type& gs, groupstates ){
+		FrameCapture::GroupInfo g;
+		g.group = gs.first;
+		g.stateless = gs.second->getStateless();
+		_c.groups.push_back( g );
+	}
+
+	boost::unordered_set< unsigned int > textures;
+
+	BOOST_FOREACH( BATCHMAPDELTA::value_type& deltapair, geometry ){
+		BOOST_FOREACH( BATCHMAPGAMMA::value_type& gammapair, deltapair.second ){
+			BOOST_FOREACH( BATCHMAPBLEND::value_type& blendpair, gammapair.second ){
+				BOOST_FOREACH( BATCHMAPBETA::value_type& betapair, blendpair.second ){
+					BOOST_FOREACH( BATCHMAPALPHA::value_type& alphapair, betapair.second ){
+
+						FrameCapture::Bucket b;
+						b.depth = deltapair.first;
+						b.group = gammapair.first;
+						b.blend = blendpair.first;
+						b.texture = betapair.first;
+						b.primitive = alphapair.first;
+						_c.buckets.push_back( b );
+						FrameCapture::Bucket& bucket = _c.buckets.back();
+
+						BOOST_FOREACH( intrusive_ptr<BatchGeometry>& geom, alphapair.second )
+						{
+							if( ! geom || geom->dropped() || ! geom->getEnabled() ) continue;
+
+							bucket.geometry.push_back( FrameCapture::Geometry() );
+							FrameCapture::Geometry& g = bucket.geometry.back();
+							g.clip = geom->getClipping();
+							g.clip_rect = geom->getClippingRectangle();
+							geom->batch( g.vertices, true );
+
+							TexturePtr t = geom->getTexture();
+							if( betapair.first != 0 && t && textures.insert( betapair.first ).second ){
+								FrameCapture::TextureInfo ti;
+								ti.id = betapair.first;
+								ti.name = t->getName();
+								ti.width = t->getWidth();
+								ti.height = t->getHeight();
+								_c.textures.push_back( ti );
+							}
+						}
+
+						if( bucket.geometry.empty() ) _c.buckets.pop_back();
+					}
+				}
+			}
 		}
 	}
 }
 
+bool BatchRenderer::capture( const std::string& _fn )
+{
+	FrameCapture c;
+	capture( c );
+	return c.save( _fn );
+}
+
 /*!
 	Main drawing routine,
 	this is the meat of phoenix, all of the important stuff goes here.
 */
 void BatchRenderer::draw( bool _persist_immediate )
 {
+	// Only one draw at a time, they share the arena.
+	boost::mutex::scoped_lock dl( draw_mutex );
 
 	persist_immediate = _persist_immediate;
 
+	// We're a reader, geometry retired during the draw stays alive until it's finished.
+	EpochGuard eg( *this );
+
+	// Apply queued changes (and merge what worker threads submitted).
+	if( threaded_submission ) setRenderThread();
+	sync();
+
 	//Do we have a shader? Activate it
 	if( shader ) shader->activate();
 
@@ -173,126 +576,80 @@ void BatchRenderer::draw( bool _persist_immediate )
     glEnableClientState(GL_COLOR_ARRAY);
     glEnableClientState(GL_VERTEX_ARRAY);
 
-	//vector to store vertices.
-	std::vector< Vertex > vlist;
-    vlist.reserve( 1000 );
-
 	//clipping variables
 	bool clipping = false;
 	Rectangle clipping_rect;
 
-	//iterate through the graph.
-	boost::recursive_mutex::scoped_lock l( getMutex() );
+	//iterate through the graph, only reading it (empty parts are pruned by sync() and clean()).
+	boost::shared_lock< boost::shared_mutex > l( graph_mutex );
 
-	//depth
-    BATCHMAPDELTA::iterator deltaend = geometry.end();
-    for( BATCHMAPDELTA::iterator deltapair = geometry.begin(); deltapair != deltaend; /*Incremented in pruning logic*/ )
+	// The group state that is currently active (begun but not ended), and its group.
+	GroupState* active = 0;
+	signed int active_group = 0;
+
+	if( group_state_hoisting )
 	{
+		// Group by group, in the order they first appear, so each state is begun once.
+		std::vector< signed int > order;
+		boost::unordered_set< signed int > seen;
+		BOOST_FOREACH( BATCHMAPDELTA::value_type& deltapair, geometry ){
+			BOOST_FOREACH( BATCHMAPGAMMA::value_type& gammapair, deltapair.second ){
+				if( seen.insert( gammapair.first ).second ) order.push_back( gammapair.first );
+			}
+		}
 
-		//Iterate through each group
-        BATCHMAPGAMMA::iterator gammaend = deltapair->second.end();
-        for( BATCHMAPGAMMA::iterator gammapair = deltapair->second.begin(); gammapair != gammaend; /*Incremented in pruning logic*/ )
+		BOOST_FOREACH( signed int group, order )
 		{
+			switchGroupState( group, active );
 
-			//activate the group state
-			GROUPSTATEMAP::iterator gs = groupstates.find( gammapair->first );
-			if( gs != groupstates.end() ) gs->second->begin( *this );
-
-			//Iterate through each texture.
-            BATCHMAPBETA::iterator betaend = gammapair->second.end();
-			for( BATCHMAPBETA::iterator betapair = gammapair->second.begin(); betapair != betaend; /*Incremented in pruning logic*/ )
+			BATCHMAPDELTA::iterator deltaend = geometry.end();
+			for( BATCHMAPDELTA::iterator deltapair = geometry.begin(); deltapair != deltaend; ++deltapair )
 			{
+				BATCHMAPGAMMA::iterator gammapair = deltapair->second.find( group );
+				if( gammapair != deltapair->second.end() ) drawGroup( gammapair->second, clipping, clipping_rect );
+			}
 
-				betapair->first == 0 ? glDisable(GL_TEXTURE_2D) : glEnable(GL_TEXTURE_2D); // should we texture? 
-				bool texture_set = false; // will be set by the first geom.
-
-				// Now run down through each primitive type
-                BATCHMAPALPHA::iterator alphaend = betapair->second.end();
-				for( BATCHMAPALPHA::iterator alphapair = betapair->second.begin(); alphapair != alphaend; /*Incremented in pruning logic*/ )
-				{
-
-					//now loop for each piece of geometry.
-                    GEOMCONTAINER::iterator geomend = alphapair->second.end();
-                    for( GEOMCONTAINER::iterator geom = alphapair->second.begin(); geom != geomend; ++geom )
-                    {
-						if( (*geom) && ! (*geom)->dropped() && (*geom)->getEnabled() )
-						{
-							// Set the texture. 
-							if( betapair->first != 0 && !texture_set ){
-								if( (*geom)->getTexture() ){
-									(*geom)->getTexture()->bind();
-									texture_set = true;
-								}
-							}
-
-							try{
-								
-								// Check for clipping, and if clipped, skip batching.
-								if( clipGeometry( *geom, clipping, clipping_rect ) ) continue;
-
-								/* Batch the vertices */
-								(*geom)->batch( vlist, persist_immediate );
-								
-								/* Do not accumulate for tri strips, line strips, line loops, triangle fans, quad strips, or polygons */
-								if( alphapair->first == GL_LINE_STRIP ||
-									alphapair->first == GL_LINE_LOOP ||
-									alphapair->first == GL_TRIANGLE_STRIP ||
-									alphapair->first == GL_TRIANGLE_FAN ||
-									alphapair->first == GL_QUAD_STRIP ||
-									alphapair->first == GL_POLYGON ){
-										// Send it on, this will also clear the list for the next geom so it doesn't acccumlate as usual.
-										submitVertexList(vlist,alphapair->first);
-								}
-
-
-							}catch(...)
-							{
-								assert( false ); // Not enough space.
-							}
-						}
-					}
-
-					// Send it on
-					submitVertexList(vlist,alphapair->first);
+			finishGroupState( active );
+		}
+	}
+	else
+	{
+		//depth
+		BATCHMAPDELTA::iterator deltaend = geometry.end();
+		for( BATCHMAPDELTA::iterator deltapair = geometry.begin(); deltapair != deltaend; ++deltapair )
+		{
+			// Start with the group whose state is still active from the previous depth, so it carries over.
+			BATCHMAPGAMMA::iterator gammaend = deltapair->second.end();
+			BATCHMAPGAMMA::iterator first = active ? deltapair->second.find( active_group ) : gammaend;
+			if( first != gammaend )
+			{
+				drawGroup( first->second, clipping, clipping_rect );
+				finishGroupState( active );
+			}
 
-					// pruning logic. 
-					if( alphapair->second.empty() ){
-						betapair->second.erase(alphapair++);
-					} else {
-						++alphapair; //business as usual
-					}
+			//Iterate through each group
+			for( BATCHMAPGAMMA::iterator gammapair = deltapair->second.begin(); gammapair != gammaend; ++gammapair )
+			{
+				if( gammapair == first ) continue;
 
-				} // Primitive Type
+				//activate the group state (if it isn't still active)
+				switchGroupState( gammapair->first, active );
+				active_group = gammapair->first;
 
-				// pruning logic. 
-				if( betapair->second.empty() ){
-					gammapair->second.erase(betapair++);
-				} else {
-					++betapair; //business as usual
-				}
+				drawGroup( gammapair->second, clipping, clipping_rect );
 
-			} // Texture
+				// call the end group function (unless it's stateless)
+				finishGroupState( active );
 
-			// call the end group function
-			if( gs != groupstates.end() ) gs->second->end( *this );
+			} // Group
 
-			// pruning logic. 
-			if( gammapair->second.empty() ){
-				deltapair->second.erase(gammapair++);
-			} else {
-				++gammapair; //business as usual
-			}
+		} //depth
+	}
 
-		} // Group
+	// End the state left active by the last group.
+	if( active ) active->end( *this );
 
-		// pruning logic. 
-		if( deltapair->second.empty() ){
-			geometry.erase(deltapair++);
-		} else {
-			++deltapair; //business as usual
-		}
-
-	} //depth
+	l.unlock();
 
     // disable states
     glDisableClientState(GL_TEXTURE_COORD_ARRAY);
@@ -317,8 +674,133 @@ void BatchRenderer::draw( bool _persist_immediate )
 	}
 
 	// Prune.
-	clean();
+	if( clean_on_draw ) clean();
+
+}
+
+/*!
+	Draws a group, blend mode by blend mode.
+	Geometry with the inherited mode goes first, so the blend function only has to be saved and restored once.
+*/
+void BatchRenderer::drawGroup( BATCHMAPBLEND& _blends, bool& clipping, phoenix::Rectangle& clipping_rect ){
+
+	BATCHMAPBLEND::iterator blendend = _blends.end();
+	BATCHMAPBLEND::iterator inherited = _blends.find( 0 );
+	if( inherited != blendend ) drawTextures( inherited->second, clipping, clipping_rect );
+
+	// The blend function set by the user or the group state.
+	GLint saved_src = GL_SRC_ALPHA, saved_dst = GL_ONE_MINUS_SRC_ALPHA;
+	bool changed = false;
+
+	for( BATCHMAPBLEND::iterator blendpair = _blends.begin(); blendpair != blendend; ++blendpair )
+	{
+		if( blendpair == inherited ) continue;
+
+		if( ! changed ){
+			glGetIntegerv( GL_BLEND_SRC, &saved_src );
+			glGetIntegerv( GL_BLEND_DST, &saved_dst );
+			changed = true;
+		}
+
+		BlendMode::fromKey( blendpair->first ).apply();
+		drawTextures( blendpair->second, clipping, clipping_rect );
+	}
+
+	if( changed ) glBlendFunc( saved_src, saved_dst );
+}
+
+/*!
+	Draws a group's blend mode, texture by texture.
+*/
+void BatchRenderer::drawTextures( BATCHMAPBETA& _textures, bool& clipping, phoenix::Rectangle& clipping_rect ){
+
+	//number of vertices in the arena.
+	unsigned int used = 0;
+
+	//Iterate through each texture.
+    BATCHMAPBETA::iterator betaend = _textures.end();
+	for( BATCHMAPBETA::iterator betapair = _textures.begin(); betapair != betaend; ++betapair )
+	{
+
+		betapair->first == 0 ? glDisable(GL_TEXTURE_2D) : glEnable(GL_TEXTURE_2D); // should we texture? 
+		bool texture_set = false; // will be set by the first geom.
+
+		// Now run down through each primitive type
+        BATCHMAPALPHA::iterator alphaend = betapair->second.end();
+		for( BATCHMAPALPHA::iterator alphapair = betapair->second.begin(); alphapair != alphaend; ++alphapair )
+		{
+
+			//now loop for each piece of geometry.
+            GEOMCONTAINER::iterator geomend = alphapair->second.end();
+            for( GEOMCONTAINER::iterator geom = alphapair->second.begin(); geom != geomend; ++geom )
+            {
+				if( (*geom) && ! (*geom)->dropped() && (*geom)->getEnabled() )
+				{
+					// Set the texture. 
+					if( betapair->first != 0 && !texture_set ){
+						if( (*geom)->getTexture() ){
+							(*geom)->getTexture()->bind();
+							texture_set = true;
+						}
+					}
+
+					try{
+						
+						// Check for clipping, and if clipped, skip batching.
+						if( clipGeometry( *geom, clipping, clipping_rect ) ) continue;
+
+						/* Batch the vertices */
+						batchGeometry( *geom, used );
+						
+						/* Do not accumulate for tri strips, line strips, line loops, triangle fans, quad strips, or polygons */
+						if( alphapair->first == GL_LINE_STRIP ||
+							alphapair->first == GL_LINE_LOOP ||
+							alphapair->first == GL_TRIANGLE_STRIP ||
+							alphapair->first == GL_TRIANGLE_FAN ||
+							alphapair->first == GL_QUAD_STRIP ||
+							alphapair->first == GL_POLYGON ){
+								// Send it on, and reset the arena for the next geom so it doesn't acccumlate as usual.
+								submitVertexList(used ? &arena[0] : 0, used, alphapair->first);
+								used = 0;
+						}
+
+
+					}catch(...)
+					{
+						assert( false ); // Not enough space.
+					}
+				}
+			}
+
+			// Send it on
+			submitVertexList(used ? &arena[0] : 0, used, alphapair->first);
+			used = 0;
+
+		} // Primitive Type
 
+	} // Texture
+}
+
+/*!
+	Group state switching.
+	The end()/begin() pair is elided if the group uses the state that is already active.
+*/
+void BatchRenderer::switchGroupState( signed int _group, GroupState*& _active ){
+	GROUPSTATEMAP::iterator gs = groupstates.find( _group );
+	GroupState* next = gs != groupstates.end() ? gs->second.get() : 0;
+
+	if( next == _active ) return;
+
+	if( _active ) _active->end( *this );
+	_active = next;
+	if( _active ) _active->begin( *this );
+}
+
+void BatchRenderer::finishGroupState( GroupState*& _active ){
+	if( _active && ! _active->getStateless() ){
+		_active->end( *this );
+		_active = 0;
+	}
 }
 
 /*!
@@ -365,6 +847,35 @@ bool BatchRenderer::clipGeometry(  boost::intrusive_ptr<BatchGeometry> geom, boo
 	}
 }
 
+/*!
+	Arena reservation.
+	Grows the arena geometrically (keeping the first _used vertices) if there isn't room for _n more.
+*/
+Vertex* BatchRenderer::reserveArena( unsigned int _used, unsigned int _n ){
+	if( arena.size() < _used + _n || arena.empty() ){
+		arena.resize( std::max<std::size_t>( std::max<std::size_t>( arena.size() * 2, _used + _n ), 1000 ) );
+	}
+	return &arena[0] + _used;
+}
+
+/*!
+	Batches a piece of geometry into the arena.
+	Sized geometry writes straight into the arena, unsized geometry is batched into the scratch list and copied.
+*/
+void BatchRenderer::batchGeometry( boost::intrusive_ptr<BatchGeometry> geom, unsigned int& _used ){
+	unsigned int n = geom->getBatchSize();
+	if( n != BatchGeometry::BATCH_UNSIZED ){
+		_used += geom->batch( reserveArena( _used, n ), persist_immediate );
+	} else {
+		scratch.clear();
+		geom->batch( scratch, persist_immediate );
+		if( ! scratch.empty() ){
+			std::copy( scratch.begin(), scratch.end(), reserveArena( _used, scratch.size() ) );
+			_used += scratch.size();
+		}
+	}
+}
+
 /*!
 	Vertex submission routine.
 	Sends data to opengl
@@ -372,16 +883,26 @@ bool BatchRenderer::clipGeometry(  boost::intrusive_ptr<BatchGeometry> geom, boo
 void BatchRenderer::submitVertexList( std::vector< Vertex >& vlist, unsigned int type ){
 	if( vlist.empty() ) return;
 
-    glTexCoordPointer(4, GL_FLOAT, sizeof(Vertex), &vlist[0].tcoords);
-    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &vlist[0].color);
-    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), &vlist[0].position);
-
-	glDrawArrays( type, 0, vlist.size() );
+	submitVertexList( &vlist[0], vlist.size(), type );
 
     //clear the vlist
 	vlist.clear();
 }
 
+/*!
+	Vertex submission routine for a span of vertices.
+	Sends data to opengl
+*/
+void BatchRenderer::submitVertexList( const Vertex* _v, unsigned int _n, unsigned int type ){
+	if( !_n ) return;
+
+    glTexCoordPointer(4, GL_FLOAT, sizeof(Vertex), &_v[0].tcoords);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &_v[0].color);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), &_v[0].position);
+
+	glDrawArrays( type, 0, _n );
+}
+
 /* Immediate drawing routine, fairly simple */
 void BatchRenderer::drawImmediately(  boost::intrusive_ptr<BatchGeometry> geom ){
 
@@ -13,18 +13,27 @@ distribution for more information.
 
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <climits>
 #include <iostream>
 #include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
 #include "config.h"
 #include "Shader.h"
 #include "AbstractGarbageCollector.h"
 #include "View.h"
 #include "Droppable.h"
 #include "GroupState.h"
+#include "BlendMode.h"
 #include "Vertex.h"
 #include "Rectangle.h"
 #include "RenderTarget.h"
+#include "FrameCapture.h"
 
 namespace phoenix
 {
@@ -42,7 +51,12 @@ class BatchGeometry;
 	go through the batching renderer. The main purpose of the batching renderer is to store all geometry 
 	and draw it at once, performing as many optimizations as possible. This adds a slight layer of complexity, 
 	but the speed tradeoff is well worth it. BatchGeometry is automatically sorted in a graph based on
-	depth, group, texture, and primitive type (in that order).
+	depth, group, blend mode, texture, and primitive type (in that order).
+
+	The graph is protected by a shared (reader/writer) lock. Traversals such as draw() and count() only need
+	shared access and can run at the same time. Structural changes are never made by add() and move() directly,
+	they are queued and applied together by sync(), which draw(), clean() and count() call first. Removing empty
+	parts of the graph is also done by sync() and clean().
 */
 class BatchRenderer
 	: public AbstractGarbageCollector
@@ -55,7 +69,9 @@ public:
 		Initializes the geometry graph and starts the garbage collection routines.
 	*/
 	BatchRenderer( )
-		: AbstractGarbageCollector(), geometry(), recyclelist(), groupstates(), shader(), target(), clear_color(0,0,0), enable_clear(false),persist_immediate(false)
+		: AbstractGarbageCollector(), geometry(), recyclelist(), groupstates(), shader(), target(), clear_color(0,0,0), enable_clear(false),persist_immediate(false), clean_on_draw(true), arena(), scratch(),
+		  thread_buffer(), command_buffers(), command_buffers_mutex(), threaded_submission(false), render_thread(), render_thread_mutex(), render_thread_generation( 1 ),
+		  graph_mutex(), pending(), pending_index(), pending_moves( 0 ), pending_mutex(), needs_sync( false ), draw_mutex(), group_state_hoisting( false )
 	{
 		//collect fast.
 		setSleepTime( 5 );
@@ -68,7 +84,9 @@ public:
 	*/
 	virtual ~BatchRenderer()
 	{
+		stop();
 		clear(); //drop all geometry.
+		reclaimAll(); //and release what was retired.
 	}
 
 	//! Add geometry to the render graph. (Automatically called by BatchGeometry::create() ).
@@ -80,12 +98,62 @@ public:
 	//! Update a geometry's position in the graph. ( Automatically called by BatchGeometry::update() ).
 	void move( boost::intrusive_ptr<BatchGeometry> _g );
 
+	//! Enable/disable threaded submission.
+	/*!
+		When enabled, add() and move() called from any thread other than the render thread (the thread that
+		enabled threaded submission, and then the one calling draw()) do not touch the graph. Instead,
+		they are recorded in a command buffer that belongs to the calling thread, and never wait on the
+		renderer. A worker thread calls submit() when the geometry it created or changed is complete, and
+		the submitted commands are merged into the graph at the start of the next draw(). Dropping geometry
+		is always lock-free, see remove().
+		\note Geometry must not be modified by a worker once it has been submitted, unless the worker
+		synchronizes with the render thread in some other way.
+		\sa submit()
+	*/
+	void setThreadedSubmission( bool _t );
+
+	//! Check if threaded submission is enabled.
+	inline bool getThreadedSubmission() const { return threaded_submission; }
+
+	//! Submits the commands recorded by the calling thread.
+	/*!
+		The commands are merged into the graph at the start of the next draw(). Does nothing on the render thread
+		or if threaded submission is disabled.
+		\sa setThreadedSubmission()
+	*/
+	void submit();
+
+	//! Applies all queued changes to the graph.
+	/*!
+		Applies the adds and moves queued since the last sync (and the commands submitted by worker threads)
+		in the order they were made, and removes empty parts of the graph. This is called automatically by
+		draw(), clean() and count(), it's only useful to call it directly to choose when the graph is locked
+		exclusively.
+	*/
+	void sync();
+
+	//! Number of moves waiting for sync().
+	/*!
+		Several moves of the same geometry between two syncs count as one, they are coalesced.
+		Moves recorded by worker threads are not counted.
+	*/
+	unsigned int getPendingMoveCount();
+
 	//! Drops all geometry.
 	void clear()
 	{
 		lock();
-		recyclelist.clear();
-		geometry.clear();
+		{
+			boost::unique_lock< boost::shared_mutex > gl( graph_mutex );
+			recyclelist.clear();
+			geometry.clear();
+		}
+		{
+			boost::mutex::scoped_lock pl( pending_mutex );
+			pending.clear();
+			pending_index.clear();
+			pending_moves = 0;
+		}
 		unlock();
 	}
 
@@ -95,6 +163,18 @@ public:
     //! Cleaning routine
 	void clean();
 
+	//! Time-budgeted cleaning routine
+	void clean( double _budget );
+
+	//! Enable/disable cleaning at the end of draw() (enabled by default).
+	/*!
+		Disable this if you call clean( double ) yourself, like RenderSystem does when it has a frame budget.
+	*/
+	inline void setCleanOnDraw( bool _c ){ clean_on_draw = _c; }
+
+	//! Check if draw() cleans.
+	inline bool getCleanOnDraw() const { return clean_on_draw; }
+
 	//! Sets the group state for a given group id.
 	inline void addGroupState( const signed int _id, GroupStatePtr _gs ){
 		groupstates[_id] = _gs; 
@@ -110,6 +190,18 @@ public:
 		return groupstates[_id];
 	}
 
+	//! Enable/disable group state hoisting.
+	/*!
+		When enabled, draw() goes through the graph group by group instead of depth by depth, so each group's
+		state is begun and ended once per draw instead of once per depth it appears at. This changes the
+		order geometry of different groups is drawn in, so only enable it if that order doesn't matter
+		(e.g. opaque geometry with depth testing). Disabled by default.
+	*/
+	inline void setGroupStateHoisting( bool _h ) { group_state_hoisting = _h; }
+
+	//! Check if group state hoisting is enabled.
+	inline bool getGroupStateHoisting() const { return group_state_hoisting; }
+
     //! Sets the renderer's view.
     inline void setView( const View& other ) { view = other; }
 
@@ -134,6 +226,21 @@ public:
 	*/
 	void draw( bool _persist_immediate = false );
 
+	//! Captures the frame.
+	/*!
+		Fills the capture with everything draw() would draw right now: the buckets of the graph with the batched
+		vertices of all enabled geometry, the textures they use, the groups with a state, the view and the clear settings.
+		Immediate geometry is not dropped by this.
+		\sa FrameCapture
+	*/
+	void capture( FrameCapture& _c );
+
+	//! Captures the frame and saves it to the given file.
+	/*!
+		\return False if the file could not be written.
+	*/
+	bool capture( const std::string& _fn );
+
 	//! Draws a single geometry immediately
 	/*!
 		Automatically activates any attached rendertarget, and deactivates it before returning.
@@ -166,14 +273,15 @@ private:
 	typedef std::list< boost::intrusive_ptr<BatchGeometry> > GEOMCONTAINER;
 	typedef boost::unordered_map< unsigned int, GEOMCONTAINER > BATCHMAPALPHA; // Primitive Keyed
 	typedef boost::unordered_map< unsigned int, BATCHMAPALPHA > BATCHMAPBETA; // Texture Keyed
-	typedef boost::unordered_map< signed int, BATCHMAPBETA > BATCHMAPGAMMA; // Group Keyed
+	typedef boost::unordered_map< unsigned int, BATCHMAPBETA > BATCHMAPBLEND; // Blend Mode Keyed
+	typedef boost::unordered_map< signed int, BATCHMAPBLEND > BATCHMAPGAMMA; // Group Keyed
 	typedef std::map< float, BATCHMAPGAMMA > BATCHMAPDELTA; // Depth Keyed (Ordered)
 
 	//! Geometry List Container.
 	BATCHMAPDELTA geometry;
 
 	//! Recycle list
-	std::vector< boost::intrusive_ptr<BatchGeometry> > recyclelist;
+	RecycleQueue< boost::intrusive_ptr<BatchGeometry> > recyclelist;
 
 	typedef boost::unordered_map< signed int, boost::shared_ptr<GroupState> > GROUPSTATEMAP;
 	//! Map of group states.
@@ -195,14 +303,179 @@ private:
 	//! Immediate persistence
 	bool persist_immediate;
 
-	//! Real removal routine ( used by clean() and move() ).
+	//! Clean at the end of draw()
+	bool clean_on_draw;
+
+	//! Collects at most _max dropped geometry, stopping early if _budget (in seconds) is non-negative and exceeded once _min have been collected.
+	void collect( unsigned int _max, double _budget, unsigned int _min = 0 );
+
+	//! Vertex arena
+	/*
+		Geometry writes its vertices directly into this while drawing. It only ever grows, so after the first few frames
+		batching does not allocate.
+	*/
+	std::vector< Vertex > arena;
+
+	//! Scratch list for geometry that can only batch into a vector.
+	std::vector< Vertex > scratch;
+
+	//! Makes sure the arena has room for _n more vertices after the first _used, and returns where they go.
+	Vertex* reserveArena( unsigned int _used, unsigned int _n );
+
+	//! Batches one piece of geometry into the arena after the first _used vertices and updates _used.
+	void batchGeometry( boost::intrusive_ptr<BatchGeometry> geom, unsigned int& _used );
+
+	//! Real removal routine ( used by clean() ), the graph must be locked exclusively.
 	void removeProper( boost::intrusive_ptr<BatchGeometry> _g , bool _inv = false);
 
+	//! Location of geometry in the graph.
+	struct GraphKey
+	{
+		float depth;
+		signed int group;
+		unsigned int blend;
+		unsigned int texture;
+		unsigned int primitive;
+	};
+
+	//! Gets the current (or, if _inv, the previous) location of some geometry.
+	static GraphKey keyOf( boost::intrusive_ptr<BatchGeometry> _g, bool _inv = false );
+
+	//! Inserts geometry at the given location.
+	void insertAt( boost::intrusive_ptr<BatchGeometry> _g, const GraphKey& _k );
+
+	//! Removes geometry from the given location, returns false if it wasn't there.
+	bool removeAt( boost::intrusive_ptr<BatchGeometry> _g, const GraphKey& _k );
+
+	//! Command recorded by a worker thread.
+	struct Command
+	{
+		enum E_TYPE { ADD, MOVE } type;
+		boost::intrusive_ptr<BatchGeometry> geom;
+		GraphKey from; //!< Where it was (MOVE).
+		GraphKey to; //!< Where it goes.
+	};
+
+	//! Command buffer of a worker thread.
+	/*
+		The recording list is only touched by its thread, the submitted list is shared with draw() and protected by the mutex.
+	*/
+	struct CommandBuffer
+	{
+		std::vector< Command > recording;
+		std::vector< Command > submitted;
+		boost::mutex mutex;
+	};
+
+	//! Thread-local handle, it shares the buffer so it outlives the thread (or the renderer).
+	struct CommandBufferHandle
+	{
+		CommandBufferHandle()
+			: buffer(), generation( 0 ), render( false )
+		{}
+
+		boost::shared_ptr< CommandBuffer > buffer;
+
+		//! The render thread generation render was computed for.
+		unsigned int generation;
+
+		//! True if this thread is the render thread.
+		bool render;
+	};
+
+	//! The calling thread's command buffer.
+	boost::thread_specific_ptr< CommandBufferHandle > thread_buffer;
+
+	//! Every command buffer.
+	std::vector< boost::shared_ptr< CommandBuffer > > command_buffers;
+	boost::mutex command_buffers_mutex;
+
+	//! Threaded submission (read by every submitting thread).
+	boost::atomic< bool > threaded_submission;
+
+	//! The render thread.
+	boost::thread::id render_thread;
+	boost::mutex render_thread_mutex;
+
+	//! Bumped whenever the render thread changes, so threads only look at render_thread again when it did.
+	boost::atomic< unsigned int > render_thread_generation;
+
+	//! Returns the calling thread's handle, and whether the thread is the render thread (without locking, unless the render thread changed).
+	CommandBufferHandle* getThreadHandle();
+
+	//! Makes the calling thread the render thread.
+	void setRenderThread();
+
+	//! Returns the calling thread's command buffer if the command should be recorded, or null if the graph may be changed directly.
+	CommandBuffer* getCommandBuffer();
+
+	//! Merges all submitted commands into the graph (called by sync() with the graph locked exclusively).
+	void mergeCommandBuffers();
+
+	//! Applies an add or move to the graph, which must be locked exclusively.
+	void applyCommand( const Command& _c );
+
+	//! Applies a batch of adds and moves with at most one command per geometry, the graph must be locked exclusively.
+	/*!
+		Moves are sorted by their source so every container that loses geometry is walked once, then everything
+		is sorted (stably) by destination so every container is looked up once.
+	*/
+	void applyCommands( std::vector< Command >& _c );
+
+	//! Orders graph keys (depth, group, blend mode, texture, primitive).
+	static bool keyLess( const GraphKey& _a, const GraphKey& _b );
+	static bool keyEqual( const GraphKey& _a, const GraphKey& _b );
+	static bool fromLess( const Command* _a, const Command* _b ) { return keyLess( _a->from, _b->from ); }
+	static bool toLess( const Command* _a, const Command* _b ) { return keyLess( _a->to, _b->to ); }
+
+	//! Queues a command, coalescing it with the pending command for the same geometry.
+	void queueCommand( const Command& _c );
+
+	//! Removes empty parts of the graph, which must be locked exclusively.
+	void prune();
+
+	//! Graph lock.
+	boost::shared_mutex graph_mutex;
+
+	//! Adds and moves waiting for sync().
+	std::vector< Command > pending;
+
+	//! Index of each geometry's command in pending.
+	boost::unordered_map< BatchGeometry*, std::size_t > pending_index;
+
+	//! Number of moves in pending.
+	unsigned int pending_moves;
+	boost::mutex pending_mutex;
+
+	//! True if sync() has something to do.
+	boost::atomic< bool > needs_sync;
+
+	//! Serializes draw() calls (they share the arena and the GL state).
+	boost::mutex draw_mutex;
+
+	//! Group state hoisting.
+	bool group_state_hoisting;
+
+	//! Draws every blend mode of a group, setting each mode once and restoring the blend function afterwards.
+	void drawGroup( BATCHMAPBLEND& _blends, bool& clipping, phoenix::Rectangle& clipping_rect );
+
+	//! Draws every texture and primitive type of a group's blend mode.
+	void drawTextures( BATCHMAPBETA& _textures, bool& clipping, phoenix::Rectangle& clipping_rect );
+
+	//! Makes the state of the given group the active one, unless it already is.
+	void switchGroupState( signed int _group, GroupState*& _active );
+
+	//! Ends the active state after a group was drawn, unless it's stateless (it then stays active for the next group).
+	void finishGroupState( GroupState*& _active );
+
 	//! Clipping Routine
 	bool clipGeometry(  boost::intrusive_ptr<BatchGeometry> geom, bool &clipping, phoenix::Rectangle &clipping_rect );
 
 	//! Vertex submission routine.
 	void submitVertexList( std::vector< Vertex >& vlist, unsigned int type );
+
+	//! Vertex submission routine for a span of vertices.
+	void submitVertexList( const Vertex* _v, unsigned int _n, unsigned int type );
 };
 
 } //namespace phoenix
@@ -0,0 +1,95 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PHBLENDMODE_H__
+#define __PHBLENDMODE_H__
+
+#include "config.h"
+
+namespace phoenix
+{
+
+	//! Blend Mode.
+	/*!
+		Describes an OpenGL blend function (source and destination factor). Geometry with a blend mode is sorted
+		by it in the BatchRenderer, so all the geometry of a group that uses the same mode is drawn with one
+		glBlendFunc() call. The default mode is inherited, which means the geometry is drawn with whatever
+		blend function is current (usually the one set by RenderSystem::setBlendMode() or a GroupState).
+		\note The inherited mode is stored as GL_ZERO, GL_ZERO, so that combination can not be used as a blend mode.
+		\sa BatchGeometry::setBlendMode(), RenderSystem::setBlendMode()
+	*/
+	class BlendMode
+	{
+
+	public:
+
+		//! Constructs the inherited blend mode.
+		BlendMode()
+			: source( GL_ZERO ), destination( GL_ZERO )
+		{}
+
+		//! Constructor.
+		/*!
+			\param _s The source factor.
+			\param _d The destination factor.
+			\sa RenderSystem::setBlendMode()
+		*/
+		BlendMode( const GLenum _s, const GLenum _d )
+			: source( _s ), destination( _d )
+		{}
+
+		//! Inherited mode, the geometry uses the current blend function.
+		inline static BlendMode Inherit() { return BlendMode(); }
+
+		//! Regular alpha blending (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA).
+		inline static BlendMode Alpha() { return BlendMode( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA ); }
+
+		//! Additive blending, for particles and lights (GL_SRC_ALPHA, GL_ONE).
+		inline static BlendMode Additive() { return BlendMode( GL_SRC_ALPHA, GL_ONE ); }
+
+		//! Blending for textures with premultiplied alpha (GL_ONE, GL_ONE_MINUS_SRC_ALPHA).
+		inline static BlendMode Premultiplied() { return BlendMode( GL_ONE, GL_ONE_MINUS_SRC_ALPHA ); }
+
+		//! Multiplies the destination by the source color (GL_DST_COLOR, GL_ZERO).
+		inline static BlendMode Multiply() { return BlendMode( GL_DST_COLOR, GL_ZERO ); }
+
+		//! Get the source factor.
+		inline GLenum getSource() const { return source; }
+
+		//! Get the destination factor.
+		inline GLenum getDestination() const { return destination; }
+
+		//! Check if this is the inherited mode.
+		inline bool isInherited() const { return source == GL_ZERO && destination == GL_ZERO; }
+
+		//! Sets the blend function (does nothing for the inherited mode).
+		inline void apply() const { if( ! isInherited() ) glBlendFunc( source, destination ); }
+
+		//! Packs the mode into a single key (used by BatchRenderer), the inherited mode is 0.
+		inline unsigned int getKey() const { return ( ( source & 0xffff ) << 16 ) | ( destination & 0xffff ); }
+
+		//! Unpacks a key made by getKey().
+		inline static BlendMode fromKey( const unsigned int _k ) { return BlendMode( _k >> 16, _k & 0xffff ); }
+
+		//! Equality operator.
+		inline bool operator==( const BlendMode& _rhs ) const { return source == _rhs.source && destination == _rhs.destination; }
+
+		//! Inequality operator.
+		inline bool operator!=( const BlendMode& _rhs ) const { return !( *this == _rhs ); }
+
+	private:
+
+		GLenum source;
+		GLenum destination;
+
+	};
+
+} //namespace phoenix
+
+#endif //__PHBLENDMODE_H__
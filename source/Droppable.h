@@ -10,7 +10,9 @@ distribution for more information.
 #ifndef __PHDROPPABLE_H__
 #define __PHDROPPABLE_H__
 
+#include <stdexcept>
 #include <boost/intrusive_ptr.hpp>
+#include <boost/atomic.hpp>
 #include "config.h"
 
 // Intrusive_ptr stuff foward decl
@@ -34,7 +36,9 @@ namespace phoenix
 	iterated over. Derived classes should add themselves to their managers
 	recycle list to be garbage collected. Dropped objects are considered
 	deleted and should be skipped during iteration. It also provides
-    the facilities for intrusive_ptr to work on droppable objects.
+    the facilities for intrusive_ptr to work on droppable objects. The
+	reference count is atomic, so pointers to droppables may be shared
+	between threads.
 	\sa AbstractGarbageCollector
 */
 class Droppable
@@ -46,6 +50,18 @@ public:
 		: _refcount(0), _dropped( false )
 	{}
 
+	//! Copies are new objects, nothing references them yet.
+	Droppable( const Droppable& _other )
+		: _refcount(0), _dropped( _other._dropped.load() )
+	{}
+
+	//! Assignment does not change the reference count.
+	Droppable& operator=( const Droppable& _other )
+	{
+		_dropped.store( _other._dropped.load() );
+		return *this;
+	}
+
 	virtual ~Droppable()
 	{
 	}
@@ -54,11 +70,12 @@ public:
 	/*!
 		Sets this object to 'dropped', and does nothing else.
 		It is encourage that derived classes overload this,
-		and simply call it with Droppable::drop().
+		and simply call it with Droppable::drop(), or use exchangeDropped()
+		when they must act only once.
 	*/
 	inline virtual void drop()
 	{
-		_dropped = true;
+		_dropped.exchange( true );
 	}
 
 	//! Dropped
@@ -69,20 +86,31 @@ public:
 	*/
 	inline bool dropped()
 	{
-		return _dropped;
+		return _dropped.load( boost::memory_order_acquire );
 	}
 
     //! Get reference count
-    inline unsigned int getReferenceCount(){ return _refcount; }
+    inline unsigned int getReferenceCount(){ return _refcount.load( boost::memory_order_relaxed ); }
 
+protected:
+
+	//! Atomically marks this object as dropped.
+	/*!
+		Returns true only for the call that dropped the object, so a derived drop()
+		that races with another thread recycles the object once.
+	*/
+	inline bool exchangeDropped()
+	{
+		return ! _dropped.exchange( true );
+	}
 
 private:
 
     friend void boost::intrusive_ptr_add_ref( Droppable* );
     friend void boost::intrusive_ptr_release( Droppable* );
 
-    unsigned int _refcount;
-	bool _dropped;
+    boost::atomic< unsigned int > _refcount;
+	boost::atomic< bool > _dropped;
 
 }; //class droppable
 
@@ -93,10 +121,10 @@ typedef boost::intrusive_ptr< Droppable > DroppablePtr;
 
 // Intrusive_ptr stuff 
 namespace boost{
-    inline void intrusive_ptr_add_ref( phoenix::Droppable* ptr ){ ++(ptr->_refcount); }
+    inline void intrusive_ptr_add_ref( phoenix::Droppable* ptr ){ ptr->_refcount.fetch_add( 1, boost::memory_order_relaxed ); }
     inline void intrusive_ptr_release( phoenix::Droppable* ptr ){
-		if( ptr->_refcount == 0 ) throw std::runtime_error("Invalid itrusive_ptr release on phoenix::Droppable");
-        if( (--ptr->_refcount) == 0){
+		if( ptr->_refcount.load( boost::memory_order_relaxed ) == 0 ) throw std::runtime_error("Invalid itrusive_ptr release on phoenix::Droppable");
+        if( ptr->_refcount.fetch_sub( 1, boost::memory_order_acq_rel ) == 1 ){
             delete ptr;
         }
     }
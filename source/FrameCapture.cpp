@@ -0,0 +1,236 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#include <fstream>
+#include <boost/foreach.hpp>
+#include "FrameCapture.h"
+
+using namespace phoenix;
+
+namespace
+{
+	// File signature and format version.
+	const char CAPTURE_MAGIC[4] = { 'P', 'H', 'F', 'C' };
+	const unsigned int CAPTURE_VERSION = 1;
+
+	template< class T >
+	inline void put( std::ostream& _o, const T& _v )
+	{
+		_o.write( reinterpret_cast< const char* >( &_v ), sizeof( T ) );
+	}
+
+	template< class T >
+	inline bool get( std::istream& _i, T& _v )
+	{
+		return _i.read( reinterpret_cast< char* >( &_v ), sizeof( T ) ).good();
+	}
+
+	inline void putVector( std::ostream& _o, const Vector2d& _v )
+	{
+		put( _o, _v.getX() );
+		put( _o, _v.getY() );
+	}
+
+	inline bool getVector( std::istream& _i, Vector2d& _v )
+	{
+		float x, y;
+		if( ! get( _i, x ) || ! get( _i, y ) ) return false;
+		_v = Vector2d( x, y );
+		return true;
+	}
+
+	inline void putString( std::ostream& _o, const std::string& _s )
+	{
+		put( _o, (unsigned int) _s.size() );
+		_o.write( _s.data(), _s.size() );
+	}
+
+	//! Bytes left in the stream, so counts read from a damaged file are checked before anything is allocated.
+	inline std::streamoff remaining( std::istream& _i )
+	{
+		const std::streampos here = _i.tellg();
+		if( here == std::streampos( -1 ) ) return 0;
+		_i.seekg( 0, std::ios::end );
+		const std::streampos end = _i.tellg();
+		_i.seekg( here );
+		return end - here;
+	}
+
+	inline bool getString( std::istream& _i, std::string& _s )
+	{
+		unsigned int n;
+		if( ! get( _i, n ) || std::streamoff( n ) > remaining( _i ) ) return false;
+		_s.resize( n );
+		return n == 0 || _i.read( &_s[0], n ).good();
+	}
+}
+
+void FrameCapture::clear()
+{
+	view = View();
+	clear_color = Color();
+	clearing = false;
+	buckets.clear();
+	textures.clear();
+	groups.clear();
+}
+
+unsigned int FrameCapture::getGeometryCount() const
+{
+	unsigned int total = 0;
+	BOOST_FOREACH( const Bucket& b, buckets ){
+		total += b.geometry.size();
+	}
+	return total;
+}
+
+unsigned int FrameCapture::getVertexCount() const
+{
+	unsigned int total = 0;
+	BOOST_FOREACH( const Bucket& b, buckets ){
+		BOOST_FOREACH( const Geometry& g, b.geometry ){
+			total += g.vertices.size();
+		}
+	}
+	return total;
+}
+
+/*
+	The format is native-endian:
+	magic, version, view (position, rotation, scale, size), clearing, clear color,
+	groups (id, stateless), textures (id, width, height, name), buckets (key, geometry (clip, rectangle, vertices)).
+	Vertices are written as they are in memory.
+*/
+bool FrameCapture::save( const std::string& _fn ) const
+{
+	std::ofstream o( _fn.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+	if( ! o ) return false;
+
+	o.write( CAPTURE_MAGIC, sizeof( CAPTURE_MAGIC ) );
+	put( o, CAPTURE_VERSION );
+
+	View v = view;
+	putVector( o, v.getPosition() );
+	put( o, v.getRotation() );
+	putVector( o, v.getScale() );
+	putVector( o, v.getSize() );
+
+	put( o, (unsigned char) clearing );
+	put( o, clear_color.getRed() );
+	put( o, clear_color.getGreen() );
+	put( o, clear_color.getBlue() );
+	put( o, clear_color.getAlpha() );
+
+	put( o, (unsigned int) groups.size() );
+	BOOST_FOREACH( const GroupInfo& g, groups ){
+		put( o, g.group );
+		put( o, (unsigned char) g.stateless );
+	}
+
+	put( o, (unsigned int) textures.size() );
+	BOOST_FOREACH( const TextureInfo& t, textures ){
+		put( o, t.id );
+		put( o, t.width );
+		put( o, t.height );
+		putString( o, t.name );
+	}
+
+	put( o, (unsigned int) buckets.size() );
+	BOOST_FOREACH( const Bucket& b, buckets ){
+		put( o, b.depth );
+		put( o, b.group );
+		put( o, b.blend );
+		put( o, b.texture );
+		put( o, b.primitive );
+		put( o, (unsigned int) b.geometry.size() );
+		BOOST_FOREACH( const Geometry& g, b.geometry ){
+			put( o, (unsigned char) g.clip );
+			putVector( o, g.clip_rect.getPosition() );
+			putVector( o, g.clip_rect.getSize() );
+			put( o, (unsigned int) g.vertices.size() );
+			if( ! g.vertices.empty() ) o.write( reinterpret_cast< const char* >( &g.vertices[0] ), g.vertices.size() * sizeof( Vertex ) );
+		}
+	}
+
+	return o.good();
+}
+
+bool FrameCapture::load( const std::string& _fn )
+{
+	clear();
+
+	std::ifstream i( _fn.c_str(), std::ios::in | std::ios::binary );
+	if( ! i ) return false;
+
+	char magic[4];
+	unsigned int version;
+	if( ! i.read( magic, sizeof( magic ) ) || std::string( magic, 4 ) != std::string( CAPTURE_MAGIC, 4 ) ) return false;
+	if( ! get( i, version ) || version != CAPTURE_VERSION ) return false;
+
+	bool ok = true;
+
+	Vector2d p, s, sz;
+	float r = 0.0f;
+	ok = ok && getVector( i, p ) && get( i, r ) && getVector( i, s ) && getVector( i, sz );
+	view = View( p, sz );
+	view.setRotation( r );
+	view.setScale( s );
+
+	unsigned char c = 0, red = 0, green = 0, blue = 0, alpha = 0;
+	ok = ok && get( i, c ) && get( i, red ) && get( i, green ) && get( i, blue ) && get( i, alpha );
+	clearing = c != 0;
+	clear_color = Color( red, green, blue, alpha );
+
+	unsigned int n = 0;
+	ok = ok && get( i, n );
+	for( unsigned int k = 0; ok && k < n; ++k )
+	{
+		GroupInfo g;
+		ok = get( i, g.group ) && get( i, c );
+		g.stateless = c != 0;
+		groups.push_back( g );
+	}
+
+	ok = ok && get( i, n );
+	for( unsigned int k = 0; ok && k < n; ++k )
+	{
+		TextureInfo t;
+		ok = get( i, t.id ) && get( i, t.width ) && get( i, t.height ) && getString( i, t.name );
+		textures.push_back( t );
+	}
+
+	ok = ok && get( i, n );
+	for( unsigned int k = 0; ok && k < n; ++k )
+	{
+		buckets.push_back( Bucket() );
+		Bucket& b = buckets.back();
+		unsigned int m = 0;
+		ok = get( i, b.depth ) && get( i, b.group ) && get( i, b.blend ) && get( i, b.texture ) && get( i, b.primitive ) && get( i, m );
+		for( unsigned int j = 0; ok && j < m; ++j )
+		{
+			b.geometry.push_back( Geometry() );
+			Geometry& g = b.geometry.back();
+			Vector2d rp, rs;
+			unsigned int vc = 0;
+			ok = get( i, c ) && getVector( i, rp ) && getVector( i, rs ) && get( i, vc );
+			g.clip = c != 0;
+			g.clip_rect = Rectangle( rp, rs );
+			if( ok && vc )
+			{
+				ok = std::streamoff( vc ) <= remaining( i ) / std::streamoff( sizeof( Vertex ) );
+				if( ! ok ) break;
+				g.vertices.resize( vc );
+				ok = i.read( reinterpret_cast< char* >( &g.vertices[0] ), vc * sizeof( Vertex ) ).good();
+			}
+		}
+	}
+
+	if( ! ok ) clear();
+	return ok;
+}
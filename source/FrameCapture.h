@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PHFRAMECAPTURE_H__
+#define __PHFRAMECAPTURE_H__
+
+#include <vector>
+#include <string>
+#include "config.h"
+#include "Vertex.h"
+#include "Color.h"
+#include "Rectangle.h"
+#include "View.h"
+
+namespace phoenix
+{
+
+	//! Frame Capture.
+	/*!
+		A snapshot of everything a BatchRenderer would draw in a frame: every bucket of the render graph with the
+		batched (transformed) vertices of its geometry, the textures they reference, the groups that have a GroupState,
+		the view and the clear settings. Captures are made with BatchRenderer::capture() and can be saved to and loaded
+		from a compact binary file, which the phoenix_replay tool renders offline.
+		\note Textures are only referenced by name and size, and group states only by group id (their code can't be saved).
+		\sa BatchRenderer::capture()
+	*/
+	class FrameCapture
+	{
+
+	public:
+
+		//! A captured piece of geometry.
+		struct Geometry
+		{
+			bool clip; //!< Clipping enabled.
+			Rectangle clip_rect; //!< Clipping rectangle.
+			std::vector< Vertex > vertices; //!< Batched vertices.
+		};
+
+		//! A captured bucket, the geometry that shares a location in the render graph.
+		struct Bucket
+		{
+			float depth;
+			signed int group;
+			unsigned int blend; //!< BlendMode key.
+			unsigned int texture; //!< Texture id, see textures.
+			unsigned int primitive;
+			std::vector< Geometry > geometry;
+		};
+
+		//! A texture referenced by the captured geometry.
+		struct TextureInfo
+		{
+			unsigned int id;
+			std::string name;
+			int width;
+			int height;
+		};
+
+		//! A group that had a GroupState.
+		struct GroupInfo
+		{
+			signed int group;
+			bool stateless;
+		};
+
+		FrameCapture()
+			: view(), clear_color(), clearing(false)
+		{}
+
+		//! Empties the capture.
+		void clear();
+
+		//! Saves the capture to a file.
+		/*!
+			\return False if the file could not be written.
+		*/
+		bool save( const std::string& _fn ) const;
+
+		//! Loads a capture from a file.
+		/*!
+			\return False if the file could not be read or isn't a capture, the capture is left empty.
+		*/
+		bool load( const std::string& _fn );
+
+		//! Total number of captured pieces of geometry.
+		unsigned int getGeometryCount() const;
+
+		//! Total number of captured vertices.
+		unsigned int getVertexCount() const;
+
+		//! The captured view.
+		View view;
+
+		//! The clear color.
+		Color clear_color;
+
+		//! True if the renderer clears the screen.
+		bool clearing;
+
+		std::vector< Bucket > buckets;
+		std::vector< TextureInfo > textures;
+		std::vector< GroupInfo > groups;
+
+	};
+
+} //namespace phoenix
+
+#endif //__PHFRAMECAPTURE_H__
@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#include "GLDeletionQueue.h"
+
+using namespace phoenix;
+
+GLDeletionQueue& GLDeletionQueue::Instance()
+{
+	static GLDeletionQueue instance;
+	return instance;
+}
+
+void GLDeletionQueue::deleteTexture( GLuint _id )
+{
+	if( !_id ) return;
+	boost::mutex::scoped_lock l( mutex );
+	textures.push_back( _id );
+}
+
+void GLDeletionQueue::deleteFramebuffer( GLuint _id )
+{
+	if( !_id ) return;
+	boost::mutex::scoped_lock l( mutex );
+	framebuffers.push_back( _id );
+}
+
+void GLDeletionQueue::deleteShader( GLuint _id )
+{
+	if( !_id ) return;
+	boost::mutex::scoped_lock l( mutex );
+	shaders.push_back( _id );
+}
+
+void GLDeletionQueue::deleteProgram( GLuint _id )
+{
+	if( !_id ) return;
+	boost::mutex::scoped_lock l( mutex );
+	programs.push_back( _id );
+}
+
+void GLDeletionQueue::deleteBuffer( GLuint _id )
+{
+	if( !_id ) return;
+	boost::mutex::scoped_lock l( mutex );
+	buffers.push_back( _id );
+}
+
+unsigned int GLDeletionQueue::flush()
+{
+	// Take the lists so the lock isn't held during the GL calls.
+	std::vector< GLuint > t, f, s, p, b;
+	{
+		boost::mutex::scoped_lock l( mutex );
+		t.swap( textures );
+		f.swap( framebuffers );
+		s.swap( shaders );
+		p.swap( programs );
+		b.swap( buffers );
+	}
+
+	if( ! t.empty() ) glDeleteTextures( t.size(), &t[0] );
+	if( ! f.empty() && GLEW_VERSION_2_0 ) glDeleteFramebuffersEXT( f.size(), &f[0] );
+	if( ! b.empty() && GLEW_VERSION_1_5 ) glDeleteBuffers( b.size(), &b[0] );
+
+	// Programs first, shaders attached to them are only deleted once they are detached.
+	for( std::vector< GLuint >::iterator i = p.begin(); i != p.end(); ++i )
+		glDeleteProgram( *i );
+	for( std::vector< GLuint >::iterator i = s.begin(); i != s.end(); ++i )
+		glDeleteShader( *i );
+
+	return t.size() + f.size() + s.size() + p.size() + b.size();
+}
+
+unsigned int GLDeletionQueue::size()
+{
+	boost::mutex::scoped_lock l( mutex );
+	return textures.size() + framebuffers.size() + shaders.size() + programs.size() + buffers.size();
+}
@@ -0,0 +1,79 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PH_GL_DELETION_QUEUE_H__
+#define __PH_GL_DELETION_QUEUE_H__
+
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+#include "config.h"
+
+namespace phoenix
+{
+
+//! Deferred OpenGL object deletion.
+/*!
+	OpenGL objects may only be deleted on the thread that owns the context, but Texture, RenderTarget and Shader
+	can be destroyed wherever their last reference is released (often the garbage collector's thread). Instead of
+	deleting their OpenGL objects in their destructors, they add them to this queue, which is flushed once per
+	frame on the render thread by RenderSystem::run(). Deleting all the queued objects of a kind is done with a single
+	call (glDeleteTextures( n, ids ), etc.). The queue functions are safe to call from any thread.
+	This class is a singleton, use Instance().
+*/
+class GLDeletionQueue
+	: boost::noncopyable
+{
+public:
+
+	//! Gets the queue.
+	static GLDeletionQueue& Instance();
+
+	//! Queues a texture for deletion.
+	void deleteTexture( GLuint _id );
+
+	//! Queues a framebuffer object for deletion.
+	void deleteFramebuffer( GLuint _id );
+
+	//! Queues a shader object for deletion.
+	void deleteShader( GLuint _id );
+
+	//! Queues a shader program for deletion.
+	void deleteProgram( GLuint _id );
+
+	//! Queues a buffer object for deletion.
+	void deleteBuffer( GLuint _id );
+
+	//! Deletes everything in the queue.
+	/*!
+		Must be called on the thread that owns the OpenGL context.
+		\return The number of objects deleted.
+	*/
+	unsigned int flush();
+
+	//! Number of objects waiting to be deleted.
+	unsigned int size();
+
+private:
+
+	GLDeletionQueue()
+		: mutex(), textures(), framebuffers(), shaders(), programs(), buffers()
+	{}
+
+	boost::mutex mutex;
+	std::vector< GLuint > textures;
+	std::vector< GLuint > framebuffers;
+	std::vector< GLuint > shaders;
+	std::vector< GLuint > programs;
+	std::vector< GLuint > buffers;
+};
+
+} //namespace phoenix
+
+#endif //__PH_GL_DELETION_QUEUE_H__
@@ -27,15 +27,32 @@ class BatchRenderer;
 	BatchRenderer::removeGroupState(). Only one state object can be applied
 	to a group at a time, if more are needed, applying the Composite pattern
 	should be considered.
+
+	A group state can declare itself stateless (see setStateless()). Its begin() and
+	end() then only depend on the group state itself, so when the renderer draws the
+	same state for several groups or depths in a row, it keeps the state active instead
+	of calling end() and begin() again in between.
 */
 class GroupState
 {
 
 public:
 
-	GroupState(){};
+	GroupState() : stateless(false) {};
 	virtual ~GroupState(){};
 
+	//! Declares whether this state is stateless across draws.
+	/*!
+		Set this to true if begin() does the same thing every time it is called and nothing
+		in between an end() and the following begin() needs the state to be restored. The
+		renderer will then elide end()/begin() pairs for adjacent groups that use this
+		state. Default is false.
+	*/
+	inline void setStateless( bool _s ) { stateless = _s; }
+
+	//! Checks if this state is stateless across draws.
+	inline bool getStateless() const { return stateless; }
+
 	//! Begin render state.
 	/*!
 		Should set up all the render states needed for the current group.
@@ -52,6 +69,11 @@ public:
 	*/
 	virtual void end( BatchRenderer& r ) = 0;
 
+protected:
+
+	//! Stateless across draws.
+	bool stateless;
+
 }; // class
 
 //! Friendly name for GroupState objects.
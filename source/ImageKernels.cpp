@@ -0,0 +1,373 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#include <cstring>
+#include "ImageKernels.h"
+#include "Simd.h"
+
+using namespace phoenix;
+
+namespace
+{
+
+	// A color as the 32-bit word it is in memory (R, G, B, A bytes).
+	inline unsigned int packColor( const Color& _c )
+	{
+		const unsigned char b[4] = { _c.getRed(), _c.getGreen(), _c.getBlue(), _c.getAlpha() };
+		unsigned int p;
+		std::memcpy( &p, b, 4 );
+		return p;
+	}
+
+	// Exact rounded division by 255 for 0 <= _t <= 255 * 255.
+	inline unsigned int div255( unsigned int _t )
+	{
+		_t += 128;
+		return ( _t + ( _t >> 8 ) ) >> 8;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Scalar kernels, these handle the tails of the SIMD loops as well.
+	////////////////////////////////////////////////////////////////////////////////
+
+	inline void fillScalar( unsigned char* _dst, unsigned int _i, unsigned int _n, unsigned int _p )
+	{
+		for( ; _i < _n; ++_i ) std::memcpy( _dst + _i * 4, &_p, 4 );
+	}
+
+	inline void blendScalar( unsigned char* _dst, const unsigned char* _src, unsigned int _i, unsigned int _n )
+	{
+		for( ; _i < _n; ++_i )
+		{
+			const unsigned char* s = _src + _i * 4;
+			unsigned char* d = _dst + _i * 4;
+			const unsigned int a = s[3];
+			d[0] = (unsigned char) div255( s[0] * a + d[0] * ( 255 - a ) );
+			d[1] = (unsigned char) div255( s[1] * a + d[1] * ( 255 - a ) );
+			d[2] = (unsigned char) div255( s[2] * a + d[2] * ( 255 - a ) );
+			d[3] = (unsigned char) div255( 255 * a + d[3] * ( 255 - a ) );
+		}
+	}
+
+	inline void swizzleScalar( unsigned char* _dst, const unsigned char* _src, unsigned int _i, unsigned int _n )
+	{
+		for( ; _i < _n; ++_i )
+		{
+			const unsigned char* s = _src + _i * 4;
+			unsigned char* d = _dst + _i * 4;
+			const unsigned char r = s[0], g = s[1], b = s[2], a = s[3];
+			d[0] = b;
+			d[1] = g;
+			d[2] = r;
+			d[3] = a;
+		}
+	}
+
+	inline void premultiplyScalar( unsigned char* _p, unsigned int _i, unsigned int _n )
+	{
+		for( ; _i < _n; ++_i )
+		{
+			unsigned char* p = _p + _i * 4;
+			p[0] = (unsigned char)( ( p[0] * p[3] + 128 ) >> 8 );
+			p[1] = (unsigned char)( ( p[1] * p[3] + 128 ) >> 8 );
+			p[2] = (unsigned char)( ( p[2] * p[3] + 128 ) >> 8 );
+		}
+	}
+
+#if PH_SIMD_SSE2
+
+	////////////////////////////////////////////////////////////////////////////////
+	// SSE2 kernels, four pixels per iteration (two per register once widened to 16 bits).
+	////////////////////////////////////////////////////////////////////////////////
+
+	unsigned int fillSSE2( unsigned char* _dst, unsigned int _n, unsigned int _p )
+	{
+		const __m128i c = _mm_set1_epi32( (int) _p );
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			_mm_storeu_si128( reinterpret_cast< __m128i* >( _dst + i * 4 ), c );
+		}
+		return i;
+	}
+
+	// Blends two widened pixels, the alpha lanes of the source are replaced by 255 (see BlendPixels()).
+	inline __m128i blendHalfSSE2( __m128i _s, __m128i _d )
+	{
+		const __m128i c255 = _mm_set1_epi16( 255 );
+		const __m128i c128 = _mm_set1_epi16( 128 );
+		const __m128i amask = _mm_set_epi16( -1, 0, 0, 0, -1, 0, 0, 0 );
+		const __m128i a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( _s, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		const __m128i s = _mm_or_si128( _mm_andnot_si128( amask, _s ), _mm_and_si128( amask, c255 ) );
+		__m128i t = _mm_add_epi16( _mm_mullo_epi16( s, a ), _mm_mullo_epi16( _d, _mm_sub_epi16( c255, a ) ) );
+		t = _mm_add_epi16( t, c128 );
+		return _mm_srli_epi16( _mm_add_epi16( t, _mm_srli_epi16( t, 8 ) ), 8 );
+	}
+
+	unsigned int blendSSE2( unsigned char* _dst, const unsigned char* _src, unsigned int _n )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			const __m128i s = _mm_loadu_si128( reinterpret_cast< const __m128i* >( _src + i * 4 ) );
+			const __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( _dst + i * 4 ) );
+			const __m128i lo = blendHalfSSE2( _mm_unpacklo_epi8( s, zero ), _mm_unpacklo_epi8( d, zero ) );
+			const __m128i hi = blendHalfSSE2( _mm_unpackhi_epi8( s, zero ), _mm_unpackhi_epi8( d, zero ) );
+			_mm_storeu_si128( reinterpret_cast< __m128i* >( _dst + i * 4 ), _mm_packus_epi16( lo, hi ) );
+		}
+		return i;
+	}
+
+	unsigned int swizzleSSE2( unsigned char* _dst, const unsigned char* _src, unsigned int _n )
+	{
+		const __m128i ga = _mm_set1_epi32( (int) 0xFF00FF00 );
+		const __m128i lo = _mm_set1_epi32( 0x000000FF );
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			const __m128i p = _mm_loadu_si128( reinterpret_cast< const __m128i* >( _src + i * 4 ) );
+			const __m128i r = _mm_slli_epi32( _mm_and_si128( p, lo ), 16 );
+			const __m128i b = _mm_and_si128( _mm_srli_epi32( p, 16 ), lo );
+			_mm_storeu_si128( reinterpret_cast< __m128i* >( _dst + i * 4 ), _mm_or_si128( _mm_and_si128( p, ga ), _mm_or_si128( r, b ) ) );
+		}
+		return i;
+	}
+
+	inline __m128i premultiplyHalfSSE2( __m128i _p )
+	{
+		const __m128i amask = _mm_set_epi16( -1, 0, 0, 0, -1, 0, 0, 0 );
+		const __m128i a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( _p, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		const __m128i c = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _p, a ), _mm_set1_epi16( 128 ) ), 8 );
+		return _mm_or_si128( _mm_andnot_si128( amask, c ), _mm_and_si128( amask, _p ) );
+	}
+
+	unsigned int premultiplySSE2( unsigned char* _p, unsigned int _n )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			const __m128i p = _mm_loadu_si128( reinterpret_cast< const __m128i* >( _p + i * 4 ) );
+			const __m128i lo = premultiplyHalfSSE2( _mm_unpacklo_epi8( p, zero ) );
+			const __m128i hi = premultiplyHalfSSE2( _mm_unpackhi_epi8( p, zero ) );
+			_mm_storeu_si128( reinterpret_cast< __m128i* >( _p + i * 4 ), _mm_packus_epi16( lo, hi ) );
+		}
+		return i;
+	}
+
+#endif //PH_SIMD_SSE2
+
+#if PH_SIMD_AVX2
+
+	////////////////////////////////////////////////////////////////////////////////
+	// AVX2 kernels, eight pixels per iteration. Unpacking and packing both work within
+	// 128-bit lanes, so the pixels come back out in the order they went in.
+	////////////////////////////////////////////////////////////////////////////////
+
+	PH_TARGET_AVX2 unsigned int fillAVX2( unsigned char* _dst, unsigned int _n, unsigned int _p )
+	{
+		const __m256i c = _mm256_set1_epi32( (int) _p );
+		unsigned int i = 0;
+		for( ; i + 8 <= _n; i += 8 )
+		{
+			_mm256_storeu_si256( reinterpret_cast< __m256i* >( _dst + i * 4 ), c );
+		}
+		return i;
+	}
+
+	PH_TARGET_AVX2 inline __m256i blendHalfAVX2( __m256i _s, __m256i _d )
+	{
+		const __m256i c255 = _mm256_set1_epi16( 255 );
+		const __m256i c128 = _mm256_set1_epi16( 128 );
+		const __m256i amask = _mm256_set_epi16( -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0 );
+		const __m256i a = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( _s, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		const __m256i s = _mm256_or_si256( _mm256_andnot_si256( amask, _s ), _mm256_and_si256( amask, c255 ) );
+		__m256i t = _mm256_add_epi16( _mm256_mullo_epi16( s, a ), _mm256_mullo_epi16( _d, _mm256_sub_epi16( c255, a ) ) );
+		t = _mm256_add_epi16( t, c128 );
+		return _mm256_srli_epi16( _mm256_add_epi16( t, _mm256_srli_epi16( t, 8 ) ), 8 );
+	}
+
+	PH_TARGET_AVX2 unsigned int blendAVX2( unsigned char* _dst, const unsigned char* _src, unsigned int _n )
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		unsigned int i = 0;
+		for( ; i + 8 <= _n; i += 8 )
+		{
+			const __m256i s = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( _src + i * 4 ) );
+			const __m256i d = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( _dst + i * 4 ) );
+			const __m256i lo = blendHalfAVX2( _mm256_unpacklo_epi8( s, zero ), _mm256_unpacklo_epi8( d, zero ) );
+			const __m256i hi = blendHalfAVX2( _mm256_unpackhi_epi8( s, zero ), _mm256_unpackhi_epi8( d, zero ) );
+			_mm256_storeu_si256( reinterpret_cast< __m256i* >( _dst + i * 4 ), _mm256_packus_epi16( lo, hi ) );
+		}
+		return i;
+	}
+
+	PH_TARGET_AVX2 unsigned int swizzleAVX2( unsigned char* _dst, const unsigned char* _src, unsigned int _n )
+	{
+		const __m256i order = _mm256_setr_epi8( 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 );
+		unsigned int i = 0;
+		for( ; i + 8 <= _n; i += 8 )
+		{
+			const __m256i p = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( _src + i * 4 ) );
+			_mm256_storeu_si256( reinterpret_cast< __m256i* >( _dst + i * 4 ), _mm256_shuffle_epi8( p, order ) );
+		}
+		return i;
+	}
+
+	PH_TARGET_AVX2 inline __m256i premultiplyHalfAVX2( __m256i _p )
+	{
+		const __m256i amask = _mm256_set_epi16( -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0 );
+		const __m256i a = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( _p, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		const __m256i c = _mm256_srli_epi16( _mm256_add_epi16( _mm256_mullo_epi16( _p, a ), _mm256_set1_epi16( 128 ) ), 8 );
+		return _mm256_or_si256( _mm256_andnot_si256( amask, c ), _mm256_and_si256( amask, _p ) );
+	}
+
+	PH_TARGET_AVX2 unsigned int premultiplyAVX2( unsigned char* _p, unsigned int _n )
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		unsigned int i = 0;
+		for( ; i + 8 <= _n; i += 8 )
+		{
+			const __m256i p = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( _p + i * 4 ) );
+			const __m256i lo = premultiplyHalfAVX2( _mm256_unpacklo_epi8( p, zero ) );
+			const __m256i hi = premultiplyHalfAVX2( _mm256_unpackhi_epi8( p, zero ) );
+			_mm256_storeu_si256( reinterpret_cast< __m256i* >( _p + i * 4 ), _mm256_packus_epi16( lo, hi ) );
+		}
+		return i;
+	}
+
+#endif //PH_SIMD_AVX2
+
+} //namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// Fill
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::FillPixels( unsigned char* _dst, unsigned int _n, const Color& _c )
+{
+	const unsigned int p = packColor( _c );
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = fillAVX2( _dst, _n, p );
+#endif
+#if PH_SIMD_SSE2
+	i += fillSSE2( _dst + i * 4, _n - i, p );
+#endif
+
+	fillScalar( _dst, i, _n, p );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Blend
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::BlendPixels( unsigned char* _dst, const unsigned char* _src, unsigned int _n )
+{
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = blendAVX2( _dst, _src, _n );
+#endif
+#if PH_SIMD_SSE2
+	i += blendSSE2( _dst + i * 4, _src + i * 4, _n - i );
+#endif
+
+	blendScalar( _dst, _src, i, _n );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Swizzle
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::SwizzlePixels( unsigned char* _dst, const unsigned char* _src, unsigned int _n )
+{
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = swizzleAVX2( _dst, _src, _n );
+#endif
+#if PH_SIMD_SSE2
+	i += swizzleSSE2( _dst + i * 4, _src + i * 4, _n - i );
+#endif
+
+	swizzleScalar( _dst, _src, i, _n );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Premultiply
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::PremultiplyPixels( unsigned char* _p, unsigned int _n )
+{
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = premultiplyAVX2( _p, _n );
+#endif
+#if PH_SIMD_SSE2
+	i += premultiplySSE2( _p + i * 4, _n - i );
+#endif
+
+	premultiplyScalar( _p, i, _n );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rectangles
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::FillPixelRect( unsigned char* _dst, unsigned int _pitch, unsigned int _w, unsigned int _h, const Color& _c )
+{
+	if( _w == _pitch )
+	{
+		FillPixels( _dst, _w * _h, _c );
+		return;
+	}
+	for( unsigned int y = 0; y < _h; ++y )
+	{
+		FillPixels( _dst + y * _pitch * 4, _w, _c );
+	}
+}
+
+void phoenix::CopyPixelRect( unsigned char* _dst, unsigned int _dpitch, const unsigned char* _src, unsigned int _spitch, unsigned int _w, unsigned int _h )
+{
+	if( _w == _dpitch && _w == _spitch )
+	{
+		std::memmove( _dst, _src, _w * _h * 4 );
+		return;
+	}
+
+	// Bottom up when copying downwards, so overlapping rectangles of the same image work.
+	if( _dst > _src )
+	{
+		for( unsigned int y = _h; y-- > 0; )
+			std::memmove( _dst + y * _dpitch * 4, _src + y * _spitch * 4, _w * 4 );
+	}
+	else
+	{
+		for( unsigned int y = 0; y < _h; ++y )
+			std::memmove( _dst + y * _dpitch * 4, _src + y * _spitch * 4, _w * 4 );
+	}
+}
+
+void phoenix::BlitPixelRect( unsigned char* _dst, unsigned int _dpitch, const unsigned char* _src, unsigned int _spitch, unsigned int _w, unsigned int _h, bool _blend )
+{
+	if( ! _blend )
+	{
+		CopyPixelRect( _dst, _dpitch, _src, _spitch, _w, _h );
+		return;
+	}
+	for( unsigned int y = 0; y < _h; ++y )
+	{
+		BlendPixels( _dst + y * _dpitch * 4, _src + y * _spitch * 4, _w );
+	}
+}
@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PHIMAGEKERNELS_H__
+#define __PHIMAGEKERNELS_H__
+
+#include "config.h"
+#include "Color.h"
+
+namespace phoenix
+{
+
+	/*
+		Bulk pixel kernels.
+
+		These functions operate on spans or rectangles of 8-bit RGBA pixels (4 bytes per pixel, pitches are
+		in pixels) such as the locked buffer of a Texture. They use SSE2 or AVX2 (chosen at runtime) when
+		available and fall back to plain scalar loops otherwise. All paths produce the same results.
+	*/
+
+	//! Set a span of pixels to a color.
+	void FillPixels( unsigned char* _dst, unsigned int _n, const Color& _c );
+
+	//! Alpha blend a span of pixels onto another (source over destination).
+	/*!
+		\f$ d_{rgb} = ( s_{rgb} s_a + d_{rgb} ( 255 - s_a ) ) / 255 \f$ and
+		\f$ d_a = ( 255 s_a + d_a ( 255 - s_a ) ) / 255 \f$, rounded to the nearest integer.
+	*/
+	void BlendPixels( unsigned char* _dst, const unsigned char* _src, unsigned int _n );
+
+	//! Swap the red and blue channels of a span of pixels (RGBA to BGRA and back).
+	/*!
+		The source and destination may be the same span.
+	*/
+	void SwizzlePixels( unsigned char* _dst, const unsigned char* _src, unsigned int _n );
+
+	//! Premultiply the colors of a span of pixels by their alpha.
+	/*!
+		\f$ c = ( c a + 128 ) / 256 \f$, the same as SOIL's SOIL_FLAG_MULTIPLY_ALPHA.
+	*/
+	void PremultiplyPixels( unsigned char* _p, unsigned int _n );
+
+	//! Set a rectangle of pixels to a color.
+	void FillPixelRect( unsigned char* _dst, unsigned int _pitch, unsigned int _w, unsigned int _h, const Color& _c );
+
+	//! Copy a rectangle of pixels.
+	/*!
+		The rectangles may overlap.
+	*/
+	void CopyPixelRect( unsigned char* _dst, unsigned int _dpitch, const unsigned char* _src, unsigned int _spitch, unsigned int _w, unsigned int _h );
+
+	//! Copy a rectangle of pixels, optionally alpha blending it (see BlendPixels()).
+	/*!
+		When blending, the rectangles must not overlap.
+	*/
+	void BlitPixelRect( unsigned char* _dst, unsigned int _dpitch, const unsigned char* _src, unsigned int _spitch, unsigned int _w, unsigned int _h, bool _blend );
+
+} //namespace phoenix
+
+#endif //__PHIMAGEKERNELS_H__
@@ -7,6 +7,7 @@
 #include "config.h"
 #include "Shader.h"
 #include "GroupState.h"
+#include "BlendMode.h"
 #include "BatchGeometry.h"
 #include "BatchRenderer.h"
 #include "ShaderGroupState.h"
@@ -14,6 +15,7 @@
 #include "Color.h"
 #include "DebugConsole.h"
 #include "EventReceiver.h"
+#include "FrameCapture.h"
 #include "Polygon.h"
 #include "Rectangle.h"
 #include "RenderSystem.h"
@@ -22,6 +24,7 @@
 #include "ResourceManager.h"
 #include "RotationMatrix.h"
 #include "Texture.h"
+#include "TextureLoader.h"
 #include "Timer.h"
 #include "Vector2d.h"
 #include "View.h"
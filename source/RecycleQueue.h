@@ -0,0 +1,114 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PH_RECYCLE_QUEUE_H__
+#define __PH_RECYCLE_QUEUE_H__
+
+#include "config.h"
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace phoenix
+{
+
+//! Lock-free recycle queue.
+/*!
+	A multiple-producer, single-consumer queue used by garbage collectors as their recycle list.
+	Any number of threads may push() at the same time without blocking, but only one thread at
+	a time may pop() or clear() (garbage collectors do this while holding their own mutex).
+	Items pushed by one thread are popped in the order they were pushed. An item may not be
+	visible to pop() until the push() that added it returns, so a clean may miss the very
+	latest drops; they are simply collected on the next pass.
+	\sa AbstractGarbageCollector
+*/
+template< class T >
+class RecycleQueue
+	: boost::noncopyable
+{
+
+public:
+
+	RecycleQueue()
+		: head(), tail( new Node() ), items( 0 )
+	{
+		head.store( tail, boost::memory_order_relaxed );
+	}
+
+	/*!
+		Releases all the items left in the queue.
+		\note There must not be any push() in progress.
+	*/
+	~RecycleQueue()
+	{
+		clear();
+		delete tail;
+	}
+
+	//! Push an item. Safe to call from any thread.
+	void push( const T& _v )
+	{
+		Node* n = new Node( _v );
+		Node* prev = head.exchange( n, boost::memory_order_acq_rel );
+		prev->next.store( n, boost::memory_order_release );
+		items.fetch_add( 1, boost::memory_order_relaxed );
+	}
+
+	//! Pop an item. Only the consumer may call this.
+	/*!
+		\return false if the queue is empty.
+	*/
+	bool pop( T& _v )
+	{
+		Node* next = tail->next.load( boost::memory_order_acquire );
+		if( ! next ) return false;
+
+		// next becomes the new dummy node, take its value.
+		_v = next->value;
+		next->value = T();
+		delete tail;
+		tail = next;
+		items.fetch_sub( 1, boost::memory_order_relaxed );
+		return true;
+	}
+
+	//! Releases all the items. Only the consumer may call this.
+	void clear()
+	{
+		T v;
+		while( pop( v ) ) {}
+	}
+
+	//! Approximate number of items in the queue.
+	inline unsigned int size() const { return items.load( boost::memory_order_relaxed ); }
+
+	//! Check if the queue is (approximately) empty.
+	inline bool empty() const { return size() == 0; }
+
+private:
+
+	struct Node
+	{
+		Node( const T& _v = T() ) : value( _v ), next( 0 ) {}
+		T value;
+		boost::atomic< Node* > next;
+	};
+
+	//! Last pushed node, producers swap this.
+	boost::atomic< Node* > head;
+
+	//! Dummy node before the first item, only the consumer touches this.
+	Node* tail;
+
+	//! Item count.
+	boost::atomic< unsigned int > items;
+};
+
+} //namespace phoenix
+
+#endif //__PH_RECYCLE_QUEUE_H__
@@ -7,6 +7,7 @@ distribution for more information.
 
 */
 
+#include <cstring>
 #include "config.h"
 #include "glew/GL/glew.h"
 #include "RenderSystem.h"
@@ -157,6 +158,11 @@ void RenderSystem::initialize( const Vector2d& _sz , bool _fs, bool _resize, boo
 
 RenderSystem::~RenderSystem()
 {
+	// Stop decoding, textures that weren't uploaded yet are released with the rest.
+	loader.stop();
+
+	// Whatever has been released so far can still be deleted while the context exists.
+	GLDeletionQueue::Instance().flush();
 	event_connection.disconnect();
 	WindowManager::Instance()->close();
 }
@@ -170,17 +176,31 @@ RenderSystem::~RenderSystem()
 bool RenderSystem::run()
 {
 
+    //Upload textures that finished loading in the background, so they are drawn this frame.
+    loader.upload( upload_budget );
+
     //Render the Debug Console.
     console->draw();
 
     //Call our own draw function
     renderer.draw();
 
+    //Clean with the time left in this frame, before flipping so it overlaps with the GPU.
+    if( frame_budget > 0.0 )
+    {
+        double left = frame_budget - fpstimer.getTime();
+        renderer.clean( left * 0.5 );
+        resources.clean( frame_budget - fpstimer.getTime() );
+    }
+
+    //Delete OpenGL objects released since the last frame (possibly on other threads).
+    GLDeletionQueue::Instance().flush();
+
     //flip the screen (this also polls events).
 	WindowManager::Instance()->update();
 
     //Clean resources
-    resources.clean();
+    if( frame_budget <= 0.0 ) resources.clean();
 
     //store the new framerate
     double newframerate = 1.0f / fpstimer.getTime();
@@ -192,6 +212,17 @@ bool RenderSystem::run()
     return !_quit; // Quit is set to true when the window manager has signaled to close.
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Frame budget
+////////////////////////////////////////////////////////////////////////////////
+
+void RenderSystem::setFrameBudget( double _b )
+{
+    frame_budget = _b;
+    // The renderer's own fixed-count clean would eat the budget.
+    renderer.setCleanOnDraw( frame_budget <= 0.0 );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Window Events
 ////////////////////////////////////////////////////////////////////////////////
@@ -242,7 +273,45 @@ void RenderSystem::onWindowEvent( const WindowEvent& e )
 //Load texture function
 ////////////////////////////////////////////////////////////////////////////////
 
-TexturePtr RenderSystem::loadTexture( const std::string& _fn, bool _l )
+namespace
+{
+
+	// SOIL's flags for the E_TEXTURE_LOAD_FLAGS.
+	unsigned int soilFlags( unsigned int _flags )
+	{
+		unsigned int flags = SOIL_FLAG_TEXTURE_REPEATS;
+		if( _flags & TLF_PREMULTIPLY ) flags |= SOIL_FLAG_MULTIPLY_ALPHA;
+		if( _flags & TLF_FLIP ) flags |= SOIL_FLAG_INVERT_Y;
+		if( _flags & TLF_MIPMAPS ) flags |= SOIL_FLAG_MIPMAPS;
+		if( _flags & TLF_COMPRESS ) flags |= SOIL_FLAG_COMPRESS_TO_DXT;
+		if( _flags & TLF_DDS_DIRECT ) flags |= SOIL_FLAG_DDS_LOAD_DIRECT;
+		return flags;
+	}
+
+	// Sets up a texture SOIL made, SOIL doesn't report the size of DDS files it loads directly.
+	void setupSoilTexture( TexturePtr _t, GLuint _id, int _w, int _h, bool _l )
+	{
+		_t->setTextureId( _id );
+		_t->updateFormat();
+
+		glBindTexture( GL_TEXTURE_2D, _id );
+		if( _w <= 0 || _h <= 0 )
+		{
+			glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &_w );
+			glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &_h );
+		}
+		_t->setWidth( _w );
+		_t->setHeight( _h );
+
+		// Use the mipmaps if there are any (generated, or from a DDS file).
+		const bool mipmaps = _t->getMipLevels() > 1;
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _l ? ( mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR ) : ( mipmaps ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST ) );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _l ? GL_LINEAR : GL_NEAREST );
+	}
+
+} //namespace
+
+TexturePtr RenderSystem::loadTexture( const std::string& _fn, bool _l, unsigned int _flags )
 {
 
 	//This is the class that will hold our texture
@@ -255,37 +324,15 @@ TexturePtr RenderSystem::loadTexture( const std::string& _fn, bool _l )
                 _fn.c_str(),
                 SOIL_LOAD_RGBA,
                 SOIL_CREATE_NEW_ID,
-                SOIL_FLAG_TEXTURE_REPEATS,
+                soilFlags( _flags ),
                 &width, &height
         );
 
 	if( newtextid != 0 )
 	{
 
-        //Load the texture
-        glBindTexture(GL_TEXTURE_2D, newtextid);
-
-        //use linear filtering
-        if ( _l == true)
-        {
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        }
-        else
-        {
-
-            //Use nearest filter
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        }
-
-        //Set up the Texture class
-        ctext->setTextureId(newtextid);
-        ctext->setWidth(width);
-        ctext->setHeight(height);
+        //Set up the Texture class (and its filtering)
+        setupSoilTexture( ctext, newtextid, width, height, _l );
         ctext->setName( _fn );
 
         //Return our texture
@@ -312,72 +359,70 @@ TexturePtr RenderSystem::loadTexture( const std::string& _fn, bool _l )
 
 }
 
+TexturePtr RenderSystem::loadTextureAsync( const std::string& _fn, bool _l, const TextureLoadCallback& _cb, TexturePtr _placeholder, unsigned int _flags )
+{
+	TexturePtr ctext = new Texture( resources );
+
+	// Reserve the name now, so geometry can use the texture before it's loaded.
+	GLuint newtextid = 0;
+	glGenTextures( 1, &newtextid );
+	ctext->setTextureId( newtextid );
+	ctext->setName( _fn );
+	ctext->setReady( false );
+	ctext->setPlaceholder( _placeholder );
+
+	loader.load( ctext, _fn, _l, _cb, _flags );
+
+	return ctext;
+}
+
 // Load texture from memory.
-TexturePtr RenderSystem::loadTexture( const unsigned char* const _d, const unsigned int _len, const std::string& _name, bool _lin )
+TexturePtr RenderSystem::loadTexture( const unsigned char* const _d, const unsigned int _len, const std::string& _name, bool _lin, unsigned int _flags )
 {
 
 	//This is the class that will hold our texture
 	TexturePtr ctext = new Texture( resources );
 
-	GLuint newtextid = SOIL_load_OGL_texture_from_memory(
-		_d,
-		_len,
-		SOIL_LOAD_RGBA,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_TEXTURE_REPEATS
-	);
-
-	if( newtextid != 0 )
+	// DDS files go straight to OpenGL, as they are.
+	if( ( _flags & TLF_DDS_DIRECT ) && _len >= 4 && std::memcmp( _d, "DDS ", 4 ) == 0 )
 	{
-        //Load the texture
-        glBindTexture(GL_TEXTURE_2D, newtextid);
-
-        //use linear filtering
-        if ( _lin == true)
-        {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        }
-        else
-        {
-            //Use nearest filter
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        }
+		GLuint newtextid = SOIL_load_OGL_texture_from_memory( _d, _len, SOIL_LOAD_RGBA, SOIL_CREATE_NEW_ID, soilFlags( _flags ) );
+		if( newtextid != 0 )
+		{
+			setupSoilTexture( ctext, newtextid, 0, 0, _lin );
+			ctext->setName( _name.size() ? _name : std::string( "Loaded From Memory" ) );
+			return ctext;
+		}
+	}
 
-        //Set up the Texture class
-        ctext->setTextureId(newtextid);
+	// Decode once, always to RGBA. The channel count is what the image had.
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = SOIL_load_image_from_memory( _d, _len, &width, &height, &channels, SOIL_LOAD_RGBA );
 
-        //Get the size from the buffer
-        int _w = 0; int _h = 0; int _c = 4;
-        unsigned char* tmp = SOIL_load_image_from_memory(_d, _len, &_w, &_h, &_c , SOIL_LOAD_AUTO); 
+	// Upload the same buffer (the flags are applied to it in place) and free it.
+	bool loaded = pixels && ctext->upload( pixels, width, height, _flags, _lin );
+	if( pixels ) SOIL_free_image_data( pixels );
 
-        //Set the sizes in the Texture object
-        ctext->setWidth( _w );
-        ctext->setHeight( _h );
+	if( loaded )
+	{
+        ctext->setChannels( channels );
         if(!_name.size())
             ctext->setName( "Loaded From Memory" );
         else 
             ctext->setName( _name );
-
-        //Return our texture
-        return ctext;
     }
     else
     {
-        TexturePtr ctext = new Texture( resources );
+        // Release the name upload() may have generated.
+        GLDeletionQueue::Instance().deleteTexture( ctext->getTextureId() );
         ctext->setTextureId(0);
         ctext->setWidth(0);
         ctext->setHeight(0);
         ctext->setName("FAILED TO LOAD");
-
-        //Return our texture
-        return ctext;
     }
 
-    //should never happen
-    return TexturePtr();
-    assert(true);
+    //Return our texture
+    return ctext;
 
 }
 
@@ -21,11 +21,14 @@ distribution for more information.
 #include "Rectangle.h"
 #include "Polygon.h"
 #include "WindowManager.h"
+#include "GLDeletionQueue.h"
+#include "TextureLoader.h"
 #include "BatchRenderer.h"
 #include "AbstractGeometryFactory.h"
 #include "DebugConsole.h"
 #include "2dGraphicsFactory.h"
 #include "Font.h"
+#include "BlendMode.h"
 
 //! The phoenix namespace.
 namespace phoenix
@@ -64,13 +67,16 @@ namespace phoenix
 			: renderer(), 
 			factory( renderer ),
 			resources(),
+			loader(),
 			console(),
 			font(0), 
 			_quit(false), 
 			event_connection(),
 			fpstimer(), 
 			framerate(1.0f), 
-			resize_behavior(RZB_NOTHING)
+			resize_behavior(RZB_NOTHING),
+			frame_budget(0.0),
+			upload_budget(0)
 		{
 			initialize( _sz, _fs, _resize, false );
 		}
@@ -116,6 +122,16 @@ namespace phoenix
       	//! Get the current blend mode's destination
         inline static int getBlendDestination() { return dst_blend; }
 
+		//! Set blend mode.
+		/*!
+			Sets the blend function to the given preset or mode. The inherited mode restores the default blend mode.
+			\sa BlendMode, BatchGeometry::setBlendMode()
+		*/
+		inline static void setBlendMode( const BlendMode& _m ) { _m.isInherited() ? setBlendMode() : setBlendMode( _m.getSource(), _m.getDestination() ); }
+
+		//! Get the current blend mode.
+		inline static BlendMode getBlendMode() { return BlendMode( src_blend, dst_blend ); }
+
 		//! Sets the current blend mode's source
 		inline static void setBlendSource( const int s ) { setBlendMode( s, getBlendDestination() ); }
 
@@ -176,6 +192,30 @@ namespace phoenix
         //! Get frames per second.
         inline const double getFPS() const { return framerate; }
 
+        //! Set the frame budget.
+        /*!
+            If this is greater than zero, run() garbage collects with whatever is left of the budget (in seconds)
+            after drawing, instead of collecting a fixed number of objects. For example, 1.0/60.0 collects for whatever
+            is left of 1/60th of a second, and only the collection rate's worth of objects once a frame runs over.
+            The default is 0 (disabled).
+            \sa AbstractGarbageCollector::clean( double )
+        */
+        void setFrameBudget( double _b );
+
+        //! Get the frame budget.
+        inline double getFrameBudget() const { return frame_budget; }
+
+        //! Set the texture upload budget.
+        /*!
+            Limits how many bytes of asynchronously loaded textures run() uploads per frame, large textures are then
+            streamed in over several frames. The default is 0 (no limit).
+            \sa loadTextureAsync(), TextureLoader::upload()
+        */
+        inline void setUploadBudget( unsigned int _b ) { upload_budget = _b; }
+
+        //! Get the texture upload budget.
+        inline unsigned int getUploadBudget() const { return upload_budget; }
+
         //! Chnage the resize mode.
         inline void setResizeBehavior( E_RESIZE_BEHAVIOR b = RZB_NOTHING) { resize_behavior = b; }
 
@@ -200,10 +240,14 @@ namespace phoenix
 			Can load .png, .tga, .bmp and .jpg or any other format supported by SOIL.
             \param _fn The filename of the image to load.
             \param _l Tells the loader to use linear filtering or not. (default true).
+            \param _flags E_TEXTURE_LOAD_FLAGS (default TLF_NONE). Use TLF_COMPRESS or TLF_DDS_DIRECT to keep the texture
+            compressed in video memory, see Texture::getMemorySize(). Use TLF_MIPMAPS for textures that are drawn smaller
+            than they are (with a zoomed out View), they are then filtered trilinearly and a third larger in video memory.
+            \note DDS files loaded with TLF_DDS_DIRECT are uploaded as they are, the other flags don't apply to them.
             \note Use nearest filtering for tilemaps, or anything that may look bad when scaled.
             \note Textures must be sizes that are a power of two. NPOT textures will experience artifacts (or may fail all together).
         */
-        TexturePtr loadTexture( const std::string& _fn , bool _l = true);
+        TexturePtr loadTexture( const std::string& _fn , bool _l = true, unsigned int _flags = TLF_NONE );
 
 		//! Load texture ( from memory )
         /*!
@@ -214,10 +258,31 @@ namespace phoenix
 			\param _len The length of the data buffer
             \param _name The optional name to set on the texture object (default "Loaded from memory")
             \param _lin Tells the loader to use linear filtering or not. (default true).
+            \param _flags E_TEXTURE_LOAD_FLAGS (default TLF_NONE).
+            \note The image is decoded once and that buffer is uploaded and freed. The texture's size and channel count are those of the image.
+            \note DDS files loaded with TLF_DDS_DIRECT aren't decoded, they are uploaded as they are.
             \note Use nearest filtering for tilemaps, or anything that may look bad when scaled.
             \note Textures must be sizes that are a power of two. NPOT textures will experience artifacts (or may fail all together).
         */
-        TexturePtr loadTexture( const unsigned char* const _d, const unsigned int _len, const std::string& _name = std::string(), bool _lin = true);
+        TexturePtr loadTexture( const unsigned char* const _d, const unsigned int _len, const std::string& _name = std::string(), bool _lin = true, unsigned int _flags = TLF_NONE );
+
+        //! Load texture asynchronously.
+        /*!
+            Returns a texture right away and loads the image in the background: it is decoded on a worker thread and
+            uploaded by run() on a later frame, then the optional callback is called (on the render thread). Until then the
+            texture isn't ready and has a size of 0, but geometry can already use it (the placeholder is drawn instead).
+            Must be called on the render thread.
+            \param _fn The filename of the image to load.
+            \param _l Tells the loader to use linear filtering or not. (default true).
+            \param _cb Called once the texture was uploaded, or with false if it failed to load.
+            \param _placeholder Optional texture to draw until this one is ready.
+            \param _flags E_TEXTURE_LOAD_FLAGS (default TLF_NONE), see TextureLoader::load() for the ones that apply.
+            \sa TextureLoader, loadTexture(), setUploadBudget()
+        */
+        TexturePtr loadTextureAsync( const std::string& _fn, bool _l = true, const TextureLoadCallback& _cb = TextureLoadCallback(), TexturePtr _placeholder = TexturePtr(), unsigned int _flags = TLF_NONE );
+
+        //! Gets the system's asynchronous texture loader.
+        inline TextureLoader& getTextureLoader() { return loader; }
 
         //! Find texture by name.
         TexturePtr findTexture(const std::string& _n);
@@ -307,6 +372,9 @@ namespace phoenix
         //! Resource manager
         ResourceManager resources;
 
+        //! Asynchronous texture loader.
+        TextureLoader loader;
+
 		//! Debug Console.
 		boost::shared_ptr<DebugConsole> console;
 
@@ -334,6 +402,12 @@ namespace phoenix
 		//! Resize behavior
 		E_RESIZE_BEHAVIOR resize_behavior;
 
+		//! Frame budget for garbage collection (in seconds), 0 to disable.
+		double frame_budget;
+
+		//! Bytes of textures uploaded per frame, 0 for no limit.
+		unsigned int upload_budget;
+
     };
 
 } //namespace phoenix
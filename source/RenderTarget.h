@@ -15,6 +15,7 @@ distribution for more information.
 #include "View.h"
 #include "Resource.h"
 #include "Texture.h"
+#include "GLDeletionQueue.h"
 
 namespace phoenix
 {
@@ -64,9 +65,8 @@ namespace phoenix
 
         virtual ~RenderTarget()
         {
-			if( GLEW_VERSION_2_0 && FBO_id){
-				glDeleteFramebuffersEXT( 1, &FBO_id );
-			}
+			// This may not be the GL thread, RenderSystem deletes it later.
+			GLDeletionQueue::Instance().deleteFramebuffer( FBO_id );
         }
 
 		//! Attaches a texture to the FBO.
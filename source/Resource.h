@@ -79,11 +79,8 @@ using boost::intrusive_ptr_release;
 			destructor is called.
         */
         inline virtual void drop(){ 
-			if( ! dropped() )
-			{
-				Droppable::drop();
+			if( exchangeDropped() )
 				_rmanager.remove( this );
-			}
 		}
 
         //! Gets this resource's ResourceManager.
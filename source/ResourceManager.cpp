@@ -37,6 +37,7 @@ Find resource
 boost::intrusive_ptr<phoenix::Resource> phoenix::ResourceManager::find( const std::string& name )
 {
 	boost::recursive_mutex::scoped_lock( *getMutex() );
+	EpochGuard eg( *this );
     for( std::list< boost::intrusive_ptr<phoenix::Resource> >::iterator i = resourcelist.begin(); i != resourcelist.end(); ++i )
     {
         if( (*i)->getName() == name )
@@ -50,20 +51,40 @@ boost::intrusive_ptr<phoenix::Resource> phoenix::ResourceManager::find( const st
 //Garbage collector
 void phoenix::ResourceManager::clean()
 {
-	
-	boost::recursive_mutex::scoped_lock l( getMutex() );
-
     unsigned int multiplier = recyclelist.size()/getCollectionRate();
     if( multiplier < getCollectionRate() ) multiplier = getCollectionRate();
+
+	// In epoch mode everything is collected, the resources are only released once no reader can see them.
+	collect( getMode() == GC_EPOCH ? UINT_MAX : multiplier, -1.0 );
+}
+
+//Time-budgeted garbage collector
+void phoenix::ResourceManager::clean( double _budget )
+{
+	// Always collect a few, so a frame that runs over budget doesn't starve the collector.
+	if( _budget < 0.0 ) _budget = 0.0;
+	collect( UINT_MAX, _budget, getCollectionRate() );
+}
+
+void phoenix::ResourceManager::collect( unsigned int _max, double _budget, unsigned int _min )
+{
+	boost::recursive_mutex::scoped_lock l( getMutex() );
+
+	const double start = gcClock();
+	unsigned int i = 0;
 	
-	for( unsigned int i = 0; i < multiplier; ++i )
+	boost::intrusive_ptr<phoenix::Resource> g;
+	for( ; i < _max; ++i )
 	{
-		if( ! recyclelist.empty() )
+		if( _budget >= 0.0 && i >= _min && gcClock() - start >= _budget ) break;
+
+		if( recyclelist.pop( g ) )
 		{
-			boost::intrusive_ptr<phoenix::Resource>& g = recyclelist.back();
 			if( g )
+			{
 				resourcelist.remove( g );
-			recyclelist.pop_back();
+				retire( g );
+			}
 		}
 		else
 		{
@@ -71,4 +92,6 @@ void phoenix::ResourceManager::clean()
 		}
 	}
 
+	reclaim();
+	recordClean( i, gcClock() - start, recyclelist.size() );
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ distribution for more information.
 #define __PHRESOURCEMANAGER_H__
 
 #include <list>
+#include <climits>
 #include <boost/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include "config.h"
@@ -73,8 +74,11 @@ using boost::intrusive_ptr_release;
         */
         virtual ~ResourceManager()
         {
+			stop();
             //drop all resources.
 			clear();
+			//and release what was retired.
+			reclaimAll();
         }
 
         //! Adds a resource to the list.
@@ -95,8 +99,9 @@ using boost::intrusive_ptr_release;
         */
         inline void remove( boost::intrusive_ptr<Resource> rc )
         {
-			boost::recursive_mutex::scoped_lock l( getMutex() );
-			recyclelist.push_back( rc );
+			// Lock-free, this never waits on the resource list.
+			recyclelist.push( rc );
+			notify();
         }
 
         //! Clear list
@@ -134,7 +139,8 @@ using boost::intrusive_ptr_release;
 			Returns a reference to the resource list.
 			\note This not <b>not</b> thread-safe! If you do any operations on the list
 			you must call lock() before and unlock() after. If you do not, prepare for a crash
-			when the garbage collector comes around.
+			when the garbage collector comes around. In GC_EPOCH mode, also hold an EpochGuard
+			while iterating so that dropped resources are not released under you.
 		*/
         inline std::list< boost::intrusive_ptr<Resource> >& getList()
         {
@@ -144,13 +150,19 @@ using boost::intrusive_ptr_release;
 		//! Clean function
 		void clean();
 
+		//! Time-budgeted clean function
+		void clean( double _budget );
+
     protected:
 
 		//! list of resources
         std::list< boost::intrusive_ptr<Resource> > resourcelist;
 
 		//! list of resources to be recycled
-		std::vector< boost::intrusive_ptr<Resource> > recyclelist;
+		RecycleQueue< boost::intrusive_ptr<Resource> > recyclelist;
+
+		//! Collects at most _max dropped resources, stopping early if _budget (in seconds) is non-negative and exceeded once _min have been collected.
+		void collect( unsigned int _max, double _budget, unsigned int _min = 0 );
 
     private:
     };
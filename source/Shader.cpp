@@ -15,9 +15,10 @@ using namespace phoenix;
 
 /* Destructor */
 Shader::~Shader(){
-	if( vertex_shader ) glDeleteShader( vertex_shader );
-	if( fragment_shader ) glDeleteShader( fragment_shader );
-	if( shader_program ) glDeleteProgram( shader_program );
+	// This may not be the GL thread, RenderSystem deletes them later.
+	GLDeletionQueue::Instance().deleteShader( vertex_shader );
+	GLDeletionQueue::Instance().deleteShader( fragment_shader );
+	GLDeletionQueue::Instance().deleteProgram( shader_program );
 }
 
 /* Acivates a shader */
@@ -0,0 +1,82 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PHSIMD_H__
+#define __PHSIMD_H__
+
+#include "config.h"
+
+/*
+	SIMD support detection.
+
+	PH_SIMD_SSE2 is defined to 1 when the compiler is targeting a processor that is guaranteed
+	to have SSE2 (every x86-64 processor). PH_SIMD_AVX2 is defined to 1 when the compiler can
+	emit AVX2 code for individual functions (marked with PH_TARGET_AVX2), these functions must
+	only be called after phoenix::CpuHasAVX2() returned true. Setting PH_USE_SIMD to 0 in
+	config.h disables both and leaves only the scalar code paths.
+*/
+
+#if PH_USE_SIMD && ( defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) )
+	#define PH_SIMD_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define PH_SIMD_SSE2 0
+#endif
+
+#if PH_SIMD_SSE2 && defined(__GNUC__) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) || defined(__clang__) )
+	#define PH_SIMD_AVX2 1
+	#define PH_TARGET_AVX2 __attribute__((target("avx2")))
+	#include <immintrin.h>
+#elif PH_SIMD_SSE2 && defined(_MSC_VER) && _MSC_VER >= 1700
+	#define PH_SIMD_AVX2 1
+	#define PH_TARGET_AVX2
+	#include <immintrin.h>
+	#include <intrin.h>
+#else
+	#define PH_SIMD_AVX2 0
+	#define PH_TARGET_AVX2
+#endif
+
+namespace phoenix
+{
+
+	//! Runtime AVX2 check.
+	/*!
+		Returns true if the processor and the operating system support AVX2. The check is performed once
+		and cached. Always returns false if PH_SIMD_AVX2 is 0.
+	*/
+	inline bool CpuHasAVX2()
+	{
+#if PH_SIMD_AVX2 && defined(__GNUC__)
+		static const bool avx2 = __builtin_cpu_supports("avx2") ? true : false;
+		return avx2;
+#elif PH_SIMD_AVX2 && defined(_MSC_VER)
+		struct Detect {
+			static bool run() {
+				int info[4];
+				__cpuid( info, 0 );
+				if( info[0] < 7 ) return false;
+				__cpuid( info, 1 );
+				// OSXSAVE and AVX, then check the OS saves the YMM registers.
+				if( ( info[2] & ( (1<<27) | (1<<28) ) ) != ( (1<<27) | (1<<28) ) ) return false;
+				if( ( _xgetbv( 0 ) & 6 ) != 6 ) return false;
+				__cpuidex( info, 7, 0 );
+				return ( info[1] & (1<<5) ) != 0;
+			}
+		};
+		static const bool avx2 = Detect::run();
+		return avx2;
+#else
+		return false;
+#endif
+	}
+
+} //namespace phoenix
+
+#endif //__PHSIMD_H__
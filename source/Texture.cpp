@@ -7,7 +7,12 @@ distribution for more information.
 
 */
 
+#include <vector>
+#include <algorithm>
+#include <cmath>
 #include "Texture.h"
+#include "ImageKernels.h"
+#include "soil/SOIL.h"
 
 using namespace phoenix;
 
@@ -29,17 +34,12 @@ void Texture::build( const Vector2d& _s, const Color& _c )
 	    setWidth( a );
 	    setHeight( b );
 
-		//make some room for the texture's data
+		//make some room for the texture's data (a persistent copy is replaced)
+		if( data != NULL ) delete [] data;
 		data = new GLubyte[a*b*4];
 
 		//make all the pixels the given color.
-		for( unsigned int i = 0; i < a; ++i )
-		{
-			for( unsigned int j = 0; j < b; ++j )
-			{
-				setPixel( Vector2d( (float) i, (float) j ), _c );
-			}
-		}
+		FillPixels( data, a*b, _c );
 
 		//Generate a texture, if we're not already one.
 		if( ! glIsTexture(texture) )
@@ -48,6 +48,7 @@ void Texture::build( const Vector2d& _s, const Color& _c )
 		}
 
 		//write the texture
+		dirty_all = true;
 		unlock();
 
 		//set the parameters
@@ -99,40 +100,78 @@ const Color Texture::getPixel( const Vector2d& _p ) const
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// lock and unlock texture
+// bulk pixel functions
 ////////////////////////////////////////////////////////////////////////////////
 
-void Texture::unlock()
+bool Texture::clip( const Rectangle& _r, int& _x0, int& _y0, int& _x1, int& _y1 ) const
 {
-    if (data!=NULL)
-    {
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-        delete [] data;
+    _x0 = std::max( 0, int( _r.getX() ) );
+    _y0 = std::max( 0, int( _r.getY() ) );
+    _x1 = std::min( width, int( std::ceil( _r.getX() + _r.getWidth() ) ) );
+    _y1 = std::min( height, int( std::ceil( _r.getY() + _r.getHeight() ) ) );
+    return _x1 > _x0 && _y1 > _y0;
+}
 
-        data = NULL;
-    }
+bool Texture::fill( const Color& _c )
+{
+    if (data==NULL) return false;
+    FillPixels( data, width*height, _c );
+    return true;
 }
 
-void Texture::unlock(bool BGRA)
+bool Texture::fill( const Rectangle& _r, const Color& _c )
 {
-    if (data!=NULL)
-    {
-        glBindTexture(GL_TEXTURE_2D, texture);
-		if(!BGRA)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		else
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
+    if (data==NULL) return false;
+    int x0, y0, x1, y1;
+    if( clip( _r, x0, y0, x1, y1 ) )
+        FillPixelRect( data + ( y0*width + x0 )*4, width, x1 - x0, y1 - y0, _c );
+    return true;
+}
 
-        delete [] data;
+bool Texture::blit( const GLubyte* _src, int _w, int _h, const Vector2d& _p, bool _blend, int _pitch )
+{
+    if (data==NULL || _src==NULL) return false;
+    if( _pitch <= 0 ) _pitch = _w;
+
+    // Clip the source against the edges of this texture.
+    const int x = int( _p.getX() );
+    const int y = int( _p.getY() );
+    const int sx = std::max( 0, -x );
+    const int sy = std::max( 0, -y );
+    const int w = std::min( _w, width - x ) - sx;
+    const int h = std::min( _h, height - y ) - sy;
+    if( w > 0 && h > 0 )
+        BlitPixelRect( data + ( ( y + sy )*width + x + sx )*4, width, _src + ( sy*_pitch + sx )*4, _pitch, w, h, _blend );
+    return true;
+}
 
-        data = NULL;
+bool Texture::blit( const Texture& _src, const Rectangle& _r, const Vector2d& _p, bool _blend )
+{
+    if (data==NULL || _src.data==NULL) return false;
+    int x0, y0, x1, y1;
+    if( _src.clip( _r, x0, y0, x1, y1 ) )
+    {
+        const Vector2d p = _p + Vector2d( float( x0 ) - std::floor( _r.getX() ), float( y0 ) - std::floor( _r.getY() ) );
+        return blit( _src.data + ( y0*_src.width + x0 )*4, x1 - x0, y1 - y0, p, _blend, _src.width );
     }
+    return true;
 }
 
-bool Texture::lock()
+bool Texture::premultiply()
 {
+    if (data==NULL) return false;
+    PremultiplyPixels( data, width*height );
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// lock and unlock texture
+////////////////////////////////////////////////////////////////////////////////
+
+bool Texture::shadow()
+{
+    if (data!=NULL) return true; // Persistent, or already locked.
+
     data = new GLubyte[width*height*4];
     if (data!=NULL)
     {
@@ -140,12 +179,248 @@ bool Texture::lock()
         glGetTexImage( GL_TEXTURE_2D , 0 , GL_RGBA , GL_UNSIGNED_BYTE, data );
         return true;
     }
-    else
+    return false;
+}
+
+bool Texture::lock()
+{
+    dirty_all = true;
+    return shadow();
+}
+
+bool Texture::lock( const Rectangle& _r )
+{
+    dirty.push_back( _r );
+    return shadow();
+}
+
+void Texture::unlock()
+{
+    uploadDirty( GL_RGBA );
+}
+
+void Texture::unlock(bool BGRA)
+{
+    uploadDirty( BGRA ? GL_BGRA_EXT : GL_RGBA );
+}
+
+void Texture::uploadDirty( GLenum _format )
+{
+    if (data==NULL) return;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    if( dirty_all )
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, _format, GL_UNSIGNED_BYTE, data);
+        generateMipmaps();
+        updateFormat();
+    }
+    else if( ! dirty.empty() )
+    {
+        // Only the changed regions, straight out of the full image.
+        glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+        glPixelStorei( GL_UNPACK_ROW_LENGTH, width );
+
+        for( std::vector< Rectangle >::iterator r = dirty.begin(); r != dirty.end(); ++r )
+        {
+            int x0, y0, x1, y1;
+            if( ! clip( *r, x0, y0, x1, y1 ) ) continue;
+
+            glPixelStorei( GL_UNPACK_SKIP_PIXELS, x0 );
+            glPixelStorei( GL_UNPACK_SKIP_ROWS, y0 );
+            glTexSubImage2D( GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, _format, GL_UNSIGNED_BYTE, data );
+        }
+
+        glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+        glPixelStorei( GL_UNPACK_SKIP_PIXELS, 0 );
+        glPixelStorei( GL_UNPACK_SKIP_ROWS, 0 );
+
+        generateMipmaps();
+    }
+
+    dirty_all = false;
+    dirty.clear();
+
+    if( ! persistent )
     {
-        return false;
+        delete [] data;
+        data = NULL;
     }
 }
 
+void Texture::setPersistent( bool _p )
+{
+    persistent = _p;
+
+    // Drop the copy, unless someone is using it.
+    if( ! persistent && data != NULL && ! dirty_all && dirty.empty() )
+    {
+        delete [] data;
+        data = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Upload an image
+////////////////////////////////////////////////////////////////////////////////
+
+bool Texture::upload( unsigned char* _pixels, int _w, int _h, unsigned int _flags, bool _linear )
+{
+	if( !_pixels || _w <= 0 || _h <= 0 ) return false;
+
+	if( !texture ) glGenTextures( 1, &texture );
+
+	// A persistent copy of the old image would be stale.
+	if( data != NULL )
+	{
+		delete [] data;
+		data = NULL;
+		dirty_all = false;
+		dirty.clear();
+	}
+
+	bool mipmaps = ( _flags & TLF_MIPMAPS ) != 0;
+	bool npot = ( _w & ( _w - 1 ) ) || ( _h & ( _h - 1 ) );
+	bool compress = ( _flags & TLF_COMPRESS ) && GLEW_EXT_texture_compression_s3tc;
+
+	// Same operations (and results) as SOIL's, in place.
+	if( _flags & TLF_FLIP )
+	{
+		const int pitch = _w * 4;
+		for( int j = 0; j * 2 < _h; ++j )
+			std::swap_ranges( _pixels + j * pitch, _pixels + ( j + 1 ) * pitch, _pixels + ( _h - 1 - j ) * pitch );
+	}
+
+	if( _flags & TLF_PREMULTIPLY ) PremultiplyPixels( _pixels, _w * _h );
+
+	// SOIL makes DXT1 out of RGB and DXT5 out of RGBA, so opaque images are repacked to get the smaller one.
+	int soilchannels = 4;
+	if( compress )
+	{
+		const int n = _w * _h;
+		int i = 0;
+		while( i < n && _pixels[i*4+3] == 255 ) ++i;
+		if( i == n )
+		{
+			for( i = 0; i < n; ++i )
+			{
+				_pixels[i*3+0] = _pixels[i*4+0];
+				_pixels[i*3+1] = _pixels[i*4+1];
+				_pixels[i*3+2] = _pixels[i*4+2];
+			}
+			soilchannels = 3;
+		}
+	}
+
+	// SOIL compresses, rescales what the hardware can't take and builds the mipmaps itself if it has to, on its own copy.
+	if( compress || ( npot && ! GLEW_VERSION_2_0 && ! GLEW_ARB_texture_non_power_of_two ) || ( mipmaps && ! GLEW_VERSION_1_4 ) )
+	{
+		unsigned int soilflags = SOIL_FLAG_TEXTURE_REPEATS;
+		if( mipmaps ) soilflags |= SOIL_FLAG_MIPMAPS;
+		if( compress ) soilflags |= SOIL_FLAG_COMPRESS_TO_DXT;
+		if( ! SOIL_create_OGL_texture( _pixels, _w, _h, soilchannels, texture, soilflags ) ) return false;
+	}
+	else
+	{
+		glBindTexture( GL_TEXTURE_2D, texture );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+
+		// Without glGenerateMipmap, have the driver build them during the upload.
+		bool generate = mipmaps && canGenerateMipmaps();
+		if( mipmaps && ! generate ) glTexParameteri( GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE );
+
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, _w, _h, 0, GL_RGBA, GL_UNSIGNED_BYTE, _pixels );
+
+		if( generate ) generateBoundMipmaps();
+	}
+
+	glBindTexture( GL_TEXTURE_2D, texture );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _linear ? ( mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR ) : ( mipmaps ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST ) );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _linear ? GL_LINEAR : GL_NEAREST );
+
+	setWidth( _w );
+	setHeight( _h );
+	updateFormat();
+
+	return true;
+}
+
+void Texture::updateFormat()
+{
+	format = 0;
+	memory = 0;
+	levels = 0;
+	compressed = false;
+	if( !texture ) return;
+
+	glBindTexture( GL_TEXTURE_2D, texture );
+
+	GLint f = 0, c = 0;
+	glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &f );
+	glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &c );
+	format = (GLenum) f;
+	compressed = c != 0;
+
+	// Every level that was specified, down to 1x1.
+	for( GLint level = 0; ; ++level )
+	{
+		GLint w = 0, h = 0;
+		glGetTexLevelParameteriv( GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &w );
+		glGetTexLevelParameteriv( GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &h );
+		if( w <= 0 || h <= 0 ) break;
+
+		if( compressed )
+		{
+			GLint size = 0;
+			glGetTexLevelParameteriv( GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size );
+			memory += size;
+		}
+		else
+		{
+			// What the driver actually stores, which isn't always what was asked for.
+			static const GLenum sizes[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_LUMINANCE_SIZE, GL_TEXTURE_INTENSITY_SIZE };
+			GLint bits = 0;
+			for( unsigned int i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); ++i )
+			{
+				GLint b = 0;
+				glGetTexLevelParameteriv( GL_TEXTURE_2D, level, sizes[i], &b );
+				bits += b;
+			}
+			memory += w * h * ( ( bits + 7 ) / 8 );
+		}
+
+		++levels;
+		if( w == 1 && h == 1 ) break;
+	}
+}
+
+void Texture::generateMipmaps()
+{
+	if( !texture || levels <= 1 || compressed ) return;
+
+	// Without glGenerateMipmap, GL_GENERATE_MIPMAP was left on by the loaders and the driver already did it.
+	if( canGenerateMipmaps() )
+	{
+		glBindTexture( GL_TEXTURE_2D, texture );
+		generateBoundMipmaps();
+	}
+}
+
+bool Texture::canGenerateMipmaps()
+{
+	return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object || GLEW_EXT_framebuffer_object;
+}
+
+void Texture::generateBoundMipmaps()
+{
+	// The core entry point is only loaded for OpenGL 3.0 or ARB_framebuffer_object, the EXT one only for EXT_framebuffer_object.
+	if( GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object ) glGenerateMipmap( GL_TEXTURE_2D );
+	else if( GLEW_EXT_framebuffer_object ) glGenerateMipmapEXT( GL_TEXTURE_2D );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Copy texture
 ////////////////////////////////////////////////////////////////////////////////
@@ -159,14 +434,27 @@ boost::intrusive_ptr<Texture> Texture::copy()
      glTexParameteri( GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER, GL_LINEAR );
      glTexParameteri( GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER, GL_LINEAR );
 
-     // bind the source texture and get the texels
-     lock();
-
-     // bind the output texture and copy the image
-     glBindTexture( GL_TEXTURE_2D, nTexID_out );
-     glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width,height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
-
-     unlock();
+     // Compressed images keep their format, read back as they are if the GPU can't copy them.
+     bool gpu = true;
+     if( compressed )
+     {
+         GLint size = 0;
+         glBindTexture( GL_TEXTURE_2D, texture );
+         glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size );
+         std::vector< GLubyte > blocks;
+         gpu = GLEW_NV_copy_image != 0;
+         if( ! gpu )
+         {
+             blocks.resize( size );
+             glGetCompressedTexImage( GL_TEXTURE_2D, 0, &blocks[0] );
+         }
+         glBindTexture( GL_TEXTURE_2D, nTexID_out );
+         glCompressedTexImage2D( GL_TEXTURE_2D, 0, format, width, height, 0, size, gpu ? NULL : &blocks[0] );
+     }
+     else
+     {
+         glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width,height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+     }
 
      TexturePtr newtexture = new Texture( getResourceManager() );
      newtexture->setTextureId( nTexID_out );
@@ -174,5 +462,126 @@ boost::intrusive_ptr<Texture> Texture::copy()
      newtexture->setHeight( height );
      newtexture->setName( getName() + " copy" );
 
+     // copy the image
+     newtexture->updateFormat();
+     if( gpu ) copyTo( *newtexture, Rectangle( 0.0f, 0.0f, float( width ), float( height ) ), Vector2d( 0.0f, 0.0f ) );
+
      return newtexture;
 }
+
+bool Texture::copyTo( Texture& _dst, const Rectangle& _r, const Vector2d& _p )
+{
+    int x0, y0, x1, y1;
+    if( ! clip( _r, x0, y0, x1, y1 ) ) return false;
+
+    // Where the clipped rectangle lands, clipped to the destination in turn.
+    int dx = int( _p.getX() ) + x0 - int( std::floor( _r.getX() ) );
+    int dy = int( _p.getY() ) + y0 - int( std::floor( _r.getY() ) );
+    if( dx < 0 ) { x0 -= dx; dx = 0; }
+    if( dy < 0 ) { y0 -= dy; dy = 0; }
+    const int w = std::min( x1 - x0, _dst.width - dx );
+    const int h = std::min( y1 - y0, _dst.height - dy );
+    if( w <= 0 || h <= 0 ) return false;
+
+    // Compressed textures can only be written by a copy of the same format.
+    const bool same_format = format == _dst.format;
+    if( _dst.compressed && ( ! same_format || ! GLEW_NV_copy_image || &_dst == this ) ) return false;
+
+    // Straight from texture to texture (a texture can't be read and written by the same copy on the GPU).
+    bool gpu = false;
+    if( &_dst != this )
+    {
+        if( GLEW_NV_copy_image && same_format )
+        {
+            glCopyImageSubDataNV( texture, GL_TEXTURE_2D, 0, x0, y0, 0, _dst.texture, GL_TEXTURE_2D, 0, dx, dy, 0, w, h, 1 );
+            gpu = true;
+        }
+        else if( GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object || GLEW_EXT_framebuffer_object )
+        {
+            gpu = copyFramebuffer( _dst, x0, y0, dx, dy, w, h );
+        }
+    }
+
+    // Through memory when the GPU couldn't do it, or to keep the destination's pixels in memory up to date.
+    if( ! gpu || _dst.data != NULL )
+    {
+        const bool had_data = data != NULL;
+        if( ! shadow() ) return false;
+
+        if( _dst.data != NULL )
+        {
+            CopyPixelRect( _dst.data + ( dy*_dst.width + dx )*4, _dst.width, data + ( y0*width + x0 )*4, width, w, h );
+        }
+
+        if( ! gpu )
+        {
+            // From the destination's pixels if it has them, the source may have been overwritten.
+            const bool from_dst = _dst.data != NULL;
+            glBindTexture( GL_TEXTURE_2D, _dst.texture );
+            glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+            glPixelStorei( GL_UNPACK_ROW_LENGTH, from_dst ? _dst.width : width );
+            glPixelStorei( GL_UNPACK_SKIP_PIXELS, from_dst ? dx : x0 );
+            glPixelStorei( GL_UNPACK_SKIP_ROWS, from_dst ? dy : y0 );
+            glTexSubImage2D( GL_TEXTURE_2D, 0, dx, dy, w, h, GL_RGBA, GL_UNSIGNED_BYTE, from_dst ? _dst.data : data );
+            glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+            glPixelStorei( GL_UNPACK_SKIP_PIXELS, 0 );
+            glPixelStorei( GL_UNPACK_SKIP_ROWS, 0 );
+        }
+
+        if( ! had_data )
+        {
+            delete [] data;
+            data = NULL;
+        }
+    }
+
+    _dst.generateMipmaps();
+
+    return true;
+}
+
+bool Texture::copyFramebuffer( Texture& _dst, int _x, int _y, int _dx, int _dy, int _w, int _h )
+{
+    // Whatever is bound (a RenderTarget, maybe) is restored afterwards.
+    GLint previous = 0;
+    glGetIntegerv( GL_FRAMEBUFFER_BINDING_EXT, &previous );
+
+    // The core entry points are only loaded for OpenGL 3.0 or ARB_framebuffer_object, the EXT ones only for EXT_framebuffer_object.
+    const bool core = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+
+    GLuint fbo = 0;
+    bool complete;
+    if( core )
+    {
+        glGenFramebuffers( 1, &fbo );
+        glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0 );
+        complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    else
+    {
+        glGenFramebuffersEXT( 1, &fbo );
+        glBindFramebufferEXT( GL_FRAMEBUFFER_EXT, fbo );
+        glFramebufferTexture2DEXT( GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, texture, 0 );
+        complete = glCheckFramebufferStatusEXT( GL_FRAMEBUFFER_EXT ) == GL_FRAMEBUFFER_COMPLETE_EXT;
+    }
+
+    if( complete )
+    {
+        glBindTexture( GL_TEXTURE_2D, _dst.texture );
+        glCopyTexSubImage2D( GL_TEXTURE_2D, 0, _dx, _dy, _x, _y, _w, _h );
+    }
+
+    if( core )
+    {
+        glBindFramebuffer( GL_FRAMEBUFFER, (GLuint) previous );
+        glDeleteFramebuffers( 1, &fbo );
+    }
+    else
+    {
+        glBindFramebufferEXT( GL_FRAMEBUFFER_EXT, (GLuint) previous );
+        glDeleteFramebuffersEXT( 1, &fbo );
+    }
+
+    return complete;
+}
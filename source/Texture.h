@@ -11,15 +11,32 @@ distribution for more information.
 #define __PHOENIXTEX_H__
 
 #include <string>
+#include <vector>
 #include <boost/noncopyable.hpp>
 #include "config.h"
 #include "Color.h"
 #include "Vector2d.h"
+#include "Rectangle.h"
 #include "Resource.h"
+#include "GLDeletionQueue.h"
 
 namespace phoenix
 {
 
+	//! Texture loading flags.
+	/*!
+		\sa Texture::upload(), RenderSystem::loadTexture()
+	*/
+	enum E_TEXTURE_LOAD_FLAGS
+	{
+		TLF_NONE = 0, //!< Upload the image as it is.
+		TLF_PREMULTIPLY = 1, //!< Premultiply the colors by alpha (for BlendMode::Premultiplied()).
+		TLF_FLIP = 2, //!< Flip the image vertically.
+		TLF_MIPMAPS = 4, //!< Generate mipmaps (and use trilinear filtering).
+		TLF_COMPRESS = 8, //!< Compress to DXT1 (opaque images) or DXT5 in video memory, if the hardware supports S3TC.
+		TLF_DDS_DIRECT = 16 //!< Upload DDS files as they are (usually compressed, with their own mipmaps) instead of decoding them.
+	};
+
     //! Texture class.
     /*!
         Provides a high-level container for OpenGL Texture Objects. This class provides methods to create, bind, and
@@ -42,7 +59,7 @@ namespace phoenix
             \note The resource type for Textures is always ERT_TEXTURE.
         */
         Texture(ResourceManager& t, const Vector2d& _s = Vector2d(0,0))
-			: Resource(t,1), texture(0), width(0), height(0), data(NULL) 
+			: Resource(t,1), texture(0), width(0), height(0), data(NULL), channels(4), format(0), memory(0), levels(0), compressed(false), ready(true), placeholder(), persistent(false), dirty_all(false), dirty()
         {
             setName( "Untitled" );
 			build(_s);
@@ -54,10 +71,8 @@ namespace phoenix
         */
         virtual ~Texture()
 		{
-			if (glIsTexture(texture))
-			{
-			   glDeleteTextures(1, &texture);
-			}
+			// This may not be the GL thread, RenderSystem deletes it later.
+			GLDeletionQueue::Instance().deleteTexture( texture );
 			if (data!=NULL)
 			{
 				delete [] data;
@@ -93,6 +108,47 @@ namespace phoenix
         //! Get height.
         inline int getHeight() const { return height; }
 
+        //! Set the number of channels the image had (uncompressed textures are always RGBA).
+        inline void setChannels( int _c ) { channels = _c; }
+
+        //! Get the number of channels the image had, 3 means it had no alpha.
+        inline int getChannels() const { return channels; }
+
+        //! Get the OpenGL internal format of the texture (GL_RGBA8, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, ...).
+        /*!
+            \sa updateFormat()
+        */
+        inline GLenum getInternalFormat() const { return format; }
+
+        //! Get the video memory used by the texture in bytes, including its mipmaps.
+        inline unsigned int getMemorySize() const { return memory; }
+
+        //! Get the number of mipmap levels the texture has (1 without mipmaps).
+        inline int getMipLevels() const { return levels; }
+
+        //! Check if the texture is compressed in video memory.
+        inline bool getCompressed() const { return compressed; }
+
+        //! Queries the internal format, mipmap levels and memory size of the texture from OpenGL.
+        /*!
+            Called by the loaders, build() and unlock(). Call it after changing the image of the texture through OpenGL
+            directly.
+        */
+        void updateFormat();
+
+        //! Rebuilds the mipmaps from the full size image.
+        /*!
+            Does nothing if the texture has no mipmaps. unlock() and copyTo() call it after changing the image, call it
+            after changing the image through OpenGL directly. Compressed mipmaps can't be rebuilt, they keep the old image.
+        */
+        void generateMipmaps();
+
+        //! Checks if mipmaps can be generated with glGenerateMipmap (OpenGL 3.0 or a framebuffer object extension).
+        static bool canGenerateMipmaps();
+
+        //! Generates the mipmaps of the bound GL_TEXTURE_2D with whichever glGenerateMipmap entry point is available.
+        static void generateBoundMipmaps();
+
         //! Get size.
         inline const Vector2d getSize() const { return Vector2d( (float) width,  (float) height ); }
 
@@ -110,14 +166,25 @@ namespace phoenix
         //! Lock.
         /*!
             Locks the texture. Before getPixel() or setPixel() can be called, this must be called first.
+            The whole texture is considered modified.
             \return True if it was able to lock the texture.
-            \sa unlock(), setPixel(), getPixel()
+            \sa unlock(), setPixel(), getPixel(), setPersistent()
         */
         bool lock();
 
+        //! Lock a region.
+        /*!
+            Locks the texture like lock(), but only the given region is considered modified, so unlock() only
+            uploads that region. Several regions can be locked before unlocking. Pixels outside of the regions
+            can still be read, but changes to them may not be uploaded.
+            \return True if it was able to lock the texture.
+            \sa lock(), unlock()
+        */
+        bool lock( const Rectangle& _r );
+
         //! Unlock.
         /*!
-            Unlocks the texture. It transfers all the texture data back into video memory. This must be called
+            Unlocks the texture. It transfers the modified (locked) regions back into video memory. This must be called
             after the user is done modifying the texture with setPixel().
             \sa lock(), setPixel(), getPixel()
         */
@@ -137,9 +204,77 @@ namespace phoenix
         //! Gets the color of the given pixel. lock() must be called before this is possible.
         const Color getPixel( const Vector2d& _p ) const;
 
+        //! Gets a row of pixels.
+        /*!
+            Returns the first of getWidth() RGBA pixels (4 bytes each) of the given row, rows follow each other without
+            padding. lock() must be called before this is possible, otherwise it returns NULL.
+        */
+        inline GLubyte* getRow( int _y ){ return data != NULL ? data + _y * width * 4 : NULL; }
+
+        //! Fills the whole texture with the given color. lock() must be called before this is possible.
+        /*!
+            \return False if the texture isn't locked.
+            \sa ImageKernels.h
+        */
+        bool fill( const Color& _c );
+
+        //! Fills a rectangle (clipped to the texture) with the given color. lock() must be called before this is possible.
+        bool fill( const Rectangle& _r, const Color& _c );
+
+        //! Copies RGBA pixels into the texture. lock() must be called before this is possible.
+        /*!
+            The pixels are clipped to the texture.
+            \param _src The source pixels.
+            \param _w The width of the source.
+            \param _h The height of the source.
+            \param _p Where to put the top left pixel of the source.
+            \param _blend Alpha blend the source over the texture instead of replacing the pixels.
+            \param _pitch The distance between source rows in pixels, 0 for _w.
+            \return False if the texture isn't locked.
+        */
+        bool blit( const GLubyte* _src, int _w, int _h, const Vector2d& _p, bool _blend = false, int _pitch = 0 );
+
+        //! Copies a rectangle of another texture into this one. Both must be locked.
+        /*!
+            The source may be this texture, but blended rectangles must not overlap.
+            \sa blit()
+        */
+        bool blit( const Texture& _src, const Rectangle& _r, const Vector2d& _p, bool _blend = false );
+
+        //! Premultiplies the colors of the texture by their alpha. lock() must be called before this is possible.
+        bool premultiply();
+
+        //! Set ready.
+		/*!
+			A texture that isn't ready (because it's still being loaded or uploaded) binds its placeholder instead
+			of itself, or no texture if it has none. Textures are ready by default.
+			\sa setPlaceholder(), RenderSystem::loadTextureAsync()
+		*/
+		inline void setReady( bool _r ) { ready = _r; }
+
+		//! Check if the texture is ready to be drawn.
+		inline bool getReady() const { return ready; }
+
+		//! Set the texture that is bound while this one isn't ready (usually a small, low resolution version).
+		inline void setPlaceholder( boost::intrusive_ptr<Texture> _p ) { placeholder = _p; }
+
+		//! Get the placeholder texture.
+		inline boost::intrusive_ptr<Texture> getPlaceholder() const { return placeholder; }
+
         //! Binds this texture as the current OpenGL texture use for drawing.
+		/*!
+			If the texture isn't ready, its placeholder is bound instead.
+			\return False if the texture (or its placeholder) could not be bound.
+		*/
         inline bool bind()
 		{
+			if( ! ready )
+			{
+				if( placeholder && placeholder.get() != this ) return placeholder->bind();
+				glBindTexture(GL_TEXTURE_2D, 0);
+				return false;
+			}
+
 			if (glIsTexture(texture)) //make sure this is a texture
 			{
 				glBindTexture(GL_TEXTURE_2D, texture); //set the texture
@@ -148,9 +283,52 @@ namespace phoenix
 			return false;
 		}
 
+        //! Upload an image.
+		/*!
+			Uploads the given RGBA pixels as this texture's image (generating an OpenGL name if it has none) and
+			sets its size. The flags are applied to the pixels in place, so the buffer is modified but never copied
+			(unless the hardware can't take the size, then SOIL rescales a copy). With TLF_COMPRESS, opaque images are
+			repacked to RGB in place and compressed to DXT1 by SOIL, others to DXT5.
+			\param _pixels RGBA pixels, top row first.
+			\param _w The width.
+			\param _h The height.
+			\param _flags E_TEXTURE_LOAD_FLAGS
+			\param _linear Use linear filtering.
+			\return False if the upload failed.
+		*/
+		bool upload( unsigned char* _pixels, int _w, int _h, unsigned int _flags = TLF_NONE, bool _linear = true );
+
+        //! Keep a persistent copy of the pixels in memory.
+        /*!
+            A persistent texture keeps its pixels after unlock(), so lock() doesn't have to read them back from video memory
+            again. This is for textures that are updated often, for small regions use lock( const Rectangle& ). Disabling it
+            frees the copy (unless the texture is locked).
+        */
+        void setPersistent( bool _p );
+
+        //! Check if the texture keeps a persistent copy of its pixels.
+        inline bool getPersistent() const { return persistent; }
+
         //! Makes a hard (separate) copy of the texture.
+        /*!
+            The copy is made on the GPU when possible (see copyTo()), so the texture doesn't have to be read back.
+        */
 		boost::intrusive_ptr<Texture> copy();
 
+        //! Copies a rectangle of this texture into another one.
+        /*!
+            Uses NV_copy_image when available, or else a framebuffer object and glCopyTexSubImage2D, so the pixels
+            never leave video memory. Without either (or when copying within the same texture) the copy goes through
+            memory. If the destination is locked or persistent its pixels in memory are updated as well. The
+            rectangle is clipped to both textures. A compressed destination can only be written with NV_copy_image, from
+            another texture of the same format.
+            \param _dst The destination texture, it may be this texture.
+            \param _r The rectangle of this texture to copy.
+            \param _p Where to put the top left pixel of the rectangle in the destination.
+            \return False if nothing was copied.
+        */
+        bool copyTo( Texture& _dst, const Rectangle& _r, const Vector2d& _p );
+
 	protected:
 
         //! Pointer to the OpenGL Texture.
@@ -168,6 +346,46 @@ namespace phoenix
         */
         GLubyte* data;
 
+		//! Channels of the source image.
+		int channels;
+
+		//! OpenGL internal format.
+		GLenum format;
+
+		//! Video memory used, in bytes.
+		unsigned int memory;
+
+		//! Mipmap levels.
+		int levels;
+
+		//! Compressed internal format.
+		bool compressed;
+
+		//! Ready to be drawn.
+		bool ready;
+
+		//! Bound while the texture isn't ready.
+		boost::intrusive_ptr<Texture> placeholder;
+
+		//! Keep data after unlock().
+		bool persistent;
+
+		//! Regions to upload on unlock().
+		bool dirty_all;
+		std::vector< Rectangle > dirty;
+
+		//! Makes sure data holds the pixels, reading them back if needed.
+		bool shadow();
+
+		//! Uploads the dirty regions of data in the given format, then frees data unless the texture is persistent.
+		void uploadDirty( GLenum _format );
+
+		//! Copies a rectangle into another texture through a temporary framebuffer object, returns false if it can't.
+		bool copyFramebuffer( Texture& _dst, int _x, int _y, int _dx, int _dy, int _w, int _h );
+
+		//! Clips a rectangle to the texture, returns false if nothing is left.
+		bool clip( const Rectangle& _r, int& _x0, int& _y0, int& _x1, int& _y1 ) const;
+
     };
 
     //! Friendly name for texture pointers
@@ -0,0 +1,252 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#include <algorithm>
+#include "TextureLoader.h"
+#include "GLDeletionQueue.h"
+#include "ImageKernels.h"
+#include "soil/SOIL.h"
+
+using namespace phoenix;
+
+TextureLoader::TextureLoader( unsigned int _threads )
+	: threads( _threads ), workers(), queue(), queue_mutex(), queue_condition(), stopping( false ), finished(), streaming(), pbo( 0 ), pending( 0 )
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	stop();
+}
+
+void TextureLoader::load( TexturePtr _t, const std::string& _fn, bool _linear, const TextureLoadCallback& _cb, unsigned int _flags )
+{
+	Job* j = new Job;
+	j->texture = _t;
+	j->filename = _fn;
+	j->linear = _linear;
+	j->flags = _flags;
+	j->callback = _cb;
+	j->pixels = 0;
+	j->width = j->height = j->channels = j->row = 0;
+
+	++pending;
+
+	boost::mutex::scoped_lock l( queue_mutex );
+
+	// After stop() nothing is decoded anymore, the texture fails on the next upload().
+	if( stopping )
+	{
+		finished.push( j );
+		return;
+	}
+
+	// Start the workers with the first texture.
+	if( workers.size() == 0 )
+	{
+		unsigned int n = threads;
+		if( n == 0 )
+		{
+			unsigned int cores = boost::thread::hardware_concurrency();
+			n = cores > 1 ? cores - 1 : 1;
+		}
+		for( unsigned int i = 0; i < n; ++i ) workers.create_thread( boost::bind( &TextureLoader::work, this ) );
+	}
+
+	queue.push_back( j );
+	queue_condition.notify_one();
+}
+
+void TextureLoader::work()
+{
+	for( ;; )
+	{
+		Job* j = 0;
+		{
+			boost::mutex::scoped_lock l( queue_mutex );
+			while( queue.empty() && ! stopping ) queue_condition.wait( l );
+			if( stopping ) return;
+			j = queue.front();
+			queue.pop_front();
+		}
+
+		// Always decoded to RGBA, channels is what the file had.
+		j->pixels = SOIL_load_image( j->filename.c_str(), &j->width, &j->height, &j->channels, SOIL_LOAD_RGBA );
+
+		// The pixel work is done here rather than on the render thread.
+		if( j->pixels && ( j->flags & TLF_FLIP ) )
+		{
+			const int pitch = j->width * 4;
+			for( int r = 0; r * 2 < j->height; ++r )
+				std::swap_ranges( j->pixels + r * pitch, j->pixels + ( r + 1 ) * pitch, j->pixels + ( j->height - 1 - r ) * pitch );
+		}
+		if( j->pixels && ( j->flags & TLF_PREMULTIPLY ) ) PremultiplyPixels( j->pixels, j->width * j->height );
+
+		finished.push( j );
+	}
+}
+
+unsigned int TextureLoader::upload( unsigned int _budget )
+{
+	// Everything that finished decoding is uploaded in order.
+	Job* j = 0;
+	while( finished.pop( j ) ) streaming.push_back( j );
+
+	unsigned int n = 0;
+	unsigned int left = _budget;
+	while( ! streaming.empty() && ( _budget == 0 || left > 0 ) )
+	{
+		j = streaming.front();
+
+		if( ! j->pixels )
+		{
+			complete( j, false );
+		}
+		else if( ( ! GLEW_VERSION_2_0 && ! GLEW_ARB_texture_non_power_of_two && ( ( j->width & ( j->width - 1 ) ) || ( j->height & ( j->height - 1 ) ) ) )
+			|| ( ( j->flags & TLF_MIPMAPS ) && ! GLEW_VERSION_1_4 ) )
+		{
+			// SOIL rescales images the hardware can't take and builds mipmaps without the driver, that can't be done in slices.
+			const bool mipmaps = ( j->flags & TLF_MIPMAPS ) != 0;
+			bool ok = SOIL_create_OGL_texture( j->pixels, j->width, j->height, 4, j->texture->getTextureId(), SOIL_FLAG_TEXTURE_REPEATS | ( mipmaps ? SOIL_FLAG_MIPMAPS : 0 ) ) != 0;
+			if( ok )
+			{
+				glBindTexture( GL_TEXTURE_2D, j->texture->getTextureId() );
+				glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, j->linear ? ( mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR ) : ( mipmaps ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST ) );
+				glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, j->linear ? GL_LINEAR : GL_NEAREST );
+			}
+			complete( j, ok );
+			left = left > unsigned( j->width * j->height * 4 ) ? left - j->width * j->height * 4 : 0;
+		}
+		else
+		{
+			const unsigned int pitch = j->width * 4;
+			int rows = j->height - j->row;
+			if( _budget ) rows = std::min( rows, int( std::max( 1u, left / pitch ) ) );
+
+			uploadRows( j, rows );
+			left = left > rows * pitch ? left - rows * pitch : 0;
+
+			// Not done yet, continue next time.
+			if( j->row < j->height ) break;
+
+			complete( j, true );
+		}
+
+		streaming.pop_front();
+		discard( j );
+		--pending;
+		++n;
+	}
+	return n;
+}
+
+void TextureLoader::uploadRows( Job* _j, int _rows )
+{
+	glBindTexture( GL_TEXTURE_2D, _j->texture->getTextureId() );
+
+	const bool mipmaps = ( _j->flags & TLF_MIPMAPS ) != 0;
+	const bool last = _j->row + _rows >= _j->height;
+	const bool generate = mipmaps && Texture::canGenerateMipmaps();
+
+	// Allocate the storage with the first slice.
+	if( _j->row == 0 )
+	{
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _j->linear ? ( mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR ) : ( mipmaps ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST ) );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _j->linear ? GL_LINEAR : GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, _j->width, _j->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+	}
+
+	// Without glGenerateMipmap the driver builds them, only once the whole image is there.
+	if( mipmaps && ! generate && last ) glTexParameteri( GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE );
+
+	const unsigned char* src = _j->pixels + _j->row * _j->width * 4;
+	const unsigned int bytes = _rows * _j->width * 4;
+
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+
+	if( GLEW_VERSION_2_1 )
+	{
+		// Orphan the buffer each time, the driver copies the slice and transfers it without blocking us.
+		if( ! pbo ) glGenBuffers( 1, &pbo );
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo );
+		glBufferData( GL_PIXEL_UNPACK_BUFFER, bytes, src, GL_STREAM_DRAW );
+		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, _j->row, _j->width, _rows, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	}
+	else
+	{
+		glTexSubImage2D( GL_TEXTURE_2D, 0, 0, _j->row, _j->width, _rows, GL_RGBA, GL_UNSIGNED_BYTE, src );
+	}
+
+	if( generate && last ) Texture::generateBoundMipmaps();
+
+	_j->row += _rows;
+}
+
+void TextureLoader::complete( Job* _j, bool _ok )
+{
+	if( _ok )
+	{
+		_j->texture->setWidth( _j->width );
+		_j->texture->setHeight( _j->height );
+		_j->texture->setChannels( _j->channels );
+		_j->texture->updateFormat();
+		_j->texture->setReady( true );
+	}
+	else
+	{
+		// The name is kept (it's deleted with the texture), but it has no image, so the placeholder stays.
+		_j->texture->setName( "FAILED TO LOAD" );
+	}
+
+	if( _j->callback ) _j->callback( _j->texture, _ok );
+}
+
+void TextureLoader::stop()
+{
+	{
+		boost::mutex::scoped_lock l( queue_mutex );
+		stopping = true;
+		queue_condition.notify_all();
+	}
+	workers.join_all();
+
+	boost::mutex::scoped_lock l( queue_mutex );
+	while( ! queue.empty() )
+	{
+		discard( queue.front() );
+		queue.pop_front();
+		--pending;
+	}
+
+	Job* j = 0;
+	while( finished.pop( j ) )
+	{
+		discard( j );
+		--pending;
+	}
+
+	while( ! streaming.empty() )
+	{
+		discard( streaming.front() );
+		streaming.pop_front();
+		--pending;
+	}
+
+	GLDeletionQueue::Instance().deleteBuffer( pbo );
+	pbo = 0;
+}
+
+void TextureLoader::discard( Job* _j )
+{
+	if( _j->pixels ) SOIL_free_image_data( _j->pixels );
+	delete _j;
+}
@@ -0,0 +1,146 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PHTEXTURELOADER_H__
+#define __PHTEXTURELOADER_H__
+
+#include <deque>
+#include <string>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include "config.h"
+#include "Texture.h"
+#include "RecycleQueue.h"
+
+namespace phoenix
+{
+
+//! Texture load callback.
+/*!
+	Called on the render thread once an asynchronously loaded texture has been uploaded. The second argument
+	is false if the image could not be loaded.
+*/
+typedef boost::function< void ( TexturePtr, bool ) > TextureLoadCallback;
+
+//! Asynchronous texture loader.
+/*!
+	Decodes images on a pool of worker threads and uploads them on the render thread. The texture object (and
+	its OpenGL name) is created right away, so it can be used by geometry before the image is loaded; it isn't
+	ready (see Texture::setReady()) and has a size of 0 until then. Decoded images wait in a queue until upload()
+	is called on the render thread, which RenderSystem::run() does once per frame. Uploads can be limited to a
+	number of bytes per call, large images are then uploaded in slices of rows over several frames (through a
+	pixel buffer object when OpenGL 2.1 is available, so the copy doesn't stall). The worker threads are only
+	started when the first texture is queued.
+	\sa RenderSystem::loadTextureAsync()
+*/
+class TextureLoader
+	: boost::noncopyable
+{
+public:
+
+	//! Constructor.
+	/*!
+		\param _threads The number of decoding threads, 0 uses one less than the number of processors (at least one).
+	*/
+	TextureLoader( unsigned int _threads = 0 );
+
+	//! Stops the workers and discards anything that wasn't uploaded.
+	~TextureLoader();
+
+	//! Queues a texture for loading.
+	/*!
+		\param _t The texture, it must already have an OpenGL name which the image will be uploaded to.
+		\param _fn The image file.
+		\param _linear Use linear filtering.
+		\param _cb Optional callback, called by upload().
+		\param _flags E_TEXTURE_LOAD_FLAGS, TLF_PREMULTIPLY, TLF_FLIP and TLF_MIPMAPS apply (the others are ignored).
+			Flipping and premultiplying are done by the decoding threads, the mipmaps are generated once the last slice
+			is uploaded.
+	*/
+	void load( TexturePtr _t, const std::string& _fn, bool _linear = true, const TextureLoadCallback& _cb = TextureLoadCallback(), unsigned int _flags = TLF_NONE );
+
+	//! Uploads decoded images.
+	/*!
+		Must be called on the thread that owns the OpenGL context. Textures are made ready and their callbacks are
+		called once they are completely uploaded. At least one row is uploaded per call, even if it's over the budget.
+		\param _budget The maximum number of bytes to upload, 0 uploads everything that was decoded.
+		\return The number of textures completed (or failed).
+	*/
+	unsigned int upload( unsigned int _budget = 0 );
+
+	//! Number of textures that are queued, being decoded or waiting to be uploaded.
+	inline unsigned int getPending() const { return pending.load( boost::memory_order_relaxed ); }
+
+	//! Sets the number of decoding threads, this only has an effect before the first texture is queued.
+	inline void setThreadCount( unsigned int _t ) { if( workers.size() == 0 ) threads = _t; }
+
+	//! Gets the number of decoding threads (0 means automatic).
+	inline unsigned int getThreadCount() const { return threads; }
+
+	//! Stops the workers and discards every texture that wasn't uploaded (their callbacks are not called).
+	/*!
+		Textures queued after this fail to load.
+	*/
+	void stop();
+
+private:
+
+	//! A texture being loaded.
+	struct Job
+	{
+		TexturePtr texture;
+		std::string filename;
+		bool linear;
+		unsigned int flags; //!< E_TEXTURE_LOAD_FLAGS.
+		TextureLoadCallback callback;
+		unsigned char* pixels; //!< Decoded RGBA pixels, null if decoding failed.
+		int width;
+		int height;
+		int channels; //!< Channels in the file.
+		int row; //!< Rows uploaded so far.
+	};
+
+	//! Worker thread routine.
+	void work();
+
+	//! Uploads the next _rows rows of a job.
+	void uploadRows( Job* _j, int _rows );
+
+	//! Finishes a job and calls its callback.
+	static void complete( Job* _j, bool _ok );
+
+	//! Frees a job.
+	static void discard( Job* _j );
+
+	unsigned int threads;
+	boost::thread_group workers;
+
+	//! Jobs waiting for a worker.
+	std::deque< Job* > queue;
+	boost::mutex queue_mutex;
+	boost::condition_variable queue_condition;
+	bool stopping;
+
+	//! Decoded jobs waiting for upload().
+	RecycleQueue< Job* > finished;
+
+	//! Jobs being uploaded (only touched by the render thread).
+	std::deque< Job* > streaming;
+
+	//! Pixel buffer used for the uploads.
+	GLuint pbo;
+
+	boost::atomic< unsigned int > pending;
+};
+
+} //namespace phoenix
+
+#endif //__PHTEXTURELOADER_H__
@@ -0,0 +1,323 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#include <cstring>
+#include <algorithm>
+#include "VertexKernels.h"
+#include "Simd.h"
+
+using namespace phoenix;
+
+namespace
+{
+
+	// Positions are stored as three consecutive floats (x, y, z) inside each vertex.
+	inline float* positionOf( Vertex* _v ) { return reinterpret_cast< float* >( &_v->position ); }
+	inline const float* positionOf( const Vertex* _v ) { return reinterpret_cast< const float* >( &_v->position ); }
+
+	// The color is a packed 32-bit word, written as raw bytes.
+	inline unsigned char* colorBytesOf( Vertex* _v ) { return reinterpret_cast< unsigned char* >( &_v->color ); }
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Scalar kernels, these handle the tails of the SIMD loops as well.
+	////////////////////////////////////////////////////////////////////////////////
+
+	inline void translateScalar( Vertex* _v, unsigned int _i, unsigned int _n, float _tx, float _ty )
+	{
+		for( ; _i < _n; ++_i )
+		{
+			float* p = positionOf( _v + _i );
+			p[0] = p[0] + _tx;
+			p[1] = p[1] + _ty;
+		}
+	}
+
+	inline void scaleScalar( Vertex* _v, unsigned int _i, unsigned int _n, float _sx, float _sy )
+	{
+		for( ; _i < _n; ++_i )
+		{
+			float* p = positionOf( _v + _i );
+			p[0] = p[0] * _sx;
+			p[1] = p[1] * _sy;
+		}
+	}
+
+	inline void transformScalar( Vertex* _dst, const Vertex* _src, unsigned int _i, unsigned int _n, const float* _m, float _tx, float _ty )
+	{
+		for( ; _i < _n; ++_i )
+		{
+			const float* s = positionOf( _src + _i );
+			float* d = positionOf( _dst + _i );
+			const float x = s[0];
+			const float y = s[1];
+			d[0] = ( ( _m[0] * x ) + ( _m[1] * y ) ) + _tx;
+			d[1] = ( ( _m[2] * x ) + ( _m[3] * y ) ) + _ty;
+		}
+	}
+
+#if PH_SIMD_SSE2
+
+	////////////////////////////////////////////////////////////////////////////////
+	// SSE2 kernels, two vertices per iteration packed as (x0, y0, x1, y1).
+	////////////////////////////////////////////////////////////////////////////////
+
+	inline __m128 loadPair( const Vertex* _v )
+	{
+		__m128 p = _mm_loadl_pi( _mm_setzero_ps(), reinterpret_cast< const __m64* >( positionOf( _v ) ) );
+		return _mm_loadh_pi( p, reinterpret_cast< const __m64* >( positionOf( _v + 1 ) ) );
+	}
+
+	inline void storePair( Vertex* _v, __m128 _p )
+	{
+		_mm_storel_pi( reinterpret_cast< __m64* >( positionOf( _v ) ), _p );
+		_mm_storeh_pi( reinterpret_cast< __m64* >( positionOf( _v + 1 ) ), _p );
+	}
+
+	unsigned int translateSSE2( Vertex* _v, unsigned int _n, float _tx, float _ty )
+	{
+		const __m128 t = _mm_setr_ps( _tx, _ty, _tx, _ty );
+		unsigned int i = 0;
+		for( ; i + 2 <= _n; i += 2 )
+		{
+			storePair( _v + i, _mm_add_ps( loadPair( _v + i ), t ) );
+		}
+		return i;
+	}
+
+	unsigned int scaleSSE2( Vertex* _v, unsigned int _n, float _sx, float _sy )
+	{
+		const __m128 s = _mm_setr_ps( _sx, _sy, _sx, _sy );
+		unsigned int i = 0;
+		for( ; i + 2 <= _n; i += 2 )
+		{
+			storePair( _v + i, _mm_mul_ps( loadPair( _v + i ), s ) );
+		}
+		return i;
+	}
+
+	/*
+		x' = m0 * x + m1 * y and y' = m2 * x + m3 * y, computed as
+		(x, y) * (m0, m3) + (y, x) * (m1, m2) so the operation order matches the scalar version.
+	*/
+	template< bool Translate >
+	unsigned int transformSSE2( Vertex* _dst, const Vertex* _src, unsigned int _n, const float* _m, float _tx, float _ty )
+	{
+		const __m128 ma = _mm_setr_ps( _m[0], _m[3], _m[0], _m[3] );
+		const __m128 mb = _mm_setr_ps( _m[1], _m[2], _m[1], _m[2] );
+		const __m128 t = _mm_setr_ps( _tx, _ty, _tx, _ty );
+		unsigned int i = 0;
+		for( ; i + 2 <= _n; i += 2 )
+		{
+			const __m128 p = loadPair( _src + i );
+			const __m128 sw = _mm_shuffle_ps( p, p, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+			const __m128 r = _mm_add_ps( _mm_mul_ps( ma, p ), _mm_mul_ps( mb, sw ) );
+			storePair( _dst + i, Translate ? _mm_add_ps( r, t ) : r );
+		}
+		return i;
+	}
+
+#endif //PH_SIMD_SSE2
+
+#if PH_SIMD_AVX2
+
+	////////////////////////////////////////////////////////////////////////////////
+	// AVX2 kernels, four vertices per iteration packed as (x0, y0, x1, y1, x2, y2, x3, y3).
+	////////////////////////////////////////////////////////////////////////////////
+
+	PH_TARGET_AVX2 inline __m256 loadQuad( const Vertex* _v )
+	{
+		__m128 lo = _mm_loadl_pi( _mm_setzero_ps(), reinterpret_cast< const __m64* >( positionOf( _v ) ) );
+		lo = _mm_loadh_pi( lo, reinterpret_cast< const __m64* >( positionOf( _v + 1 ) ) );
+		__m128 hi = _mm_loadl_pi( _mm_setzero_ps(), reinterpret_cast< const __m64* >( positionOf( _v + 2 ) ) );
+		hi = _mm_loadh_pi( hi, reinterpret_cast< const __m64* >( positionOf( _v + 3 ) ) );
+		return _mm256_insertf128_ps( _mm256_castps128_ps256( lo ), hi, 1 );
+	}
+
+	PH_TARGET_AVX2 inline void storeQuad( Vertex* _v, __m256 _p )
+	{
+		const __m128 lo = _mm256_castps256_ps128( _p );
+		const __m128 hi = _mm256_extractf128_ps( _p, 1 );
+		_mm_storel_pi( reinterpret_cast< __m64* >( positionOf( _v ) ), lo );
+		_mm_storeh_pi( reinterpret_cast< __m64* >( positionOf( _v + 1 ) ), lo );
+		_mm_storel_pi( reinterpret_cast< __m64* >( positionOf( _v + 2 ) ), hi );
+		_mm_storeh_pi( reinterpret_cast< __m64* >( positionOf( _v + 3 ) ), hi );
+	}
+
+	PH_TARGET_AVX2 unsigned int translateAVX2( Vertex* _v, unsigned int _n, float _tx, float _ty )
+	{
+		const __m256 t = _mm256_setr_ps( _tx, _ty, _tx, _ty, _tx, _ty, _tx, _ty );
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			storeQuad( _v + i, _mm256_add_ps( loadQuad( _v + i ), t ) );
+		}
+		return i;
+	}
+
+	PH_TARGET_AVX2 unsigned int scaleAVX2( Vertex* _v, unsigned int _n, float _sx, float _sy )
+	{
+		const __m256 s = _mm256_setr_ps( _sx, _sy, _sx, _sy, _sx, _sy, _sx, _sy );
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			storeQuad( _v + i, _mm256_mul_ps( loadQuad( _v + i ), s ) );
+		}
+		return i;
+	}
+
+	template< bool Translate >
+	PH_TARGET_AVX2 unsigned int transformAVX2( Vertex* _dst, const Vertex* _src, unsigned int _n, const float* _m, float _tx, float _ty )
+	{
+		const __m256 ma = _mm256_setr_ps( _m[0], _m[3], _m[0], _m[3], _m[0], _m[3], _m[0], _m[3] );
+		const __m256 mb = _mm256_setr_ps( _m[1], _m[2], _m[1], _m[2], _m[1], _m[2], _m[1], _m[2] );
+		const __m256 t = _mm256_setr_ps( _tx, _ty, _tx, _ty, _tx, _ty, _tx, _ty );
+		unsigned int i = 0;
+		for( ; i + 4 <= _n; i += 4 )
+		{
+			const __m256 p = loadQuad( _src + i );
+			const __m256 sw = _mm256_permute_ps( p, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+			const __m256 r = _mm256_add_ps( _mm256_mul_ps( ma, p ), _mm256_mul_ps( mb, sw ) );
+			storeQuad( _dst + i, Translate ? _mm256_add_ps( r, t ) : r );
+		}
+		return i;
+	}
+
+#endif //PH_SIMD_AVX2
+
+} //namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// Translate
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::TranslateVertices( Vertex* _v, unsigned int _n, const Vector2d& _t )
+{
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = translateAVX2( _v, _n, _t.getX(), _t.getY() );
+#endif
+#if PH_SIMD_SSE2
+	i += translateSSE2( _v + i, _n - i, _t.getX(), _t.getY() );
+#endif
+
+	translateScalar( _v, i, _n, _t.getX(), _t.getY() );
+
+	// Z is rarely used, so it gets its own pass only when needed.
+	if( _t.getZ() != 0.0f )
+	{
+		for( unsigned int j = 0; j < _n; ++j )
+		{
+			positionOf( _v + j )[2] += _t.getZ();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scale
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::ScaleVertices( Vertex* _v, unsigned int _n, const Vector2d& _s )
+{
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = scaleAVX2( _v, _n, _s.getX(), _s.getY() );
+#endif
+#if PH_SIMD_SSE2
+	i += scaleSSE2( _v + i, _n - i, _s.getX(), _s.getY() );
+#endif
+
+	scaleScalar( _v, i, _n, _s.getX(), _s.getY() );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rotate
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::RotateVertices( Vertex* _v, unsigned int _n, const RotationMatrix& _m )
+{
+	const float m[4] = { _m.getElement(0), _m.getElement(1), _m.getElement(2), _m.getElement(3) };
+	unsigned int i = 0;
+
+#if PH_SIMD_SSE2
+	#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = transformAVX2< false >( _v, _v, _n, m, 0.0f, 0.0f );
+	#endif
+	i += transformSSE2< false >( _v + i, _v + i, _n - i, m, 0.0f, 0.0f );
+#endif
+
+	for( ; i < _n; ++i )
+	{
+		float* p = positionOf( _v + i );
+		const float x = p[0];
+		const float y = p[1];
+		p[0] = ( m[0] * x ) + ( m[1] * y );
+		p[1] = ( m[2] * x ) + ( m[3] * y );
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Affine transform
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::TransformVertices( Vertex* _dst, const Vertex* _src, unsigned int _n, const RotationMatrix& _m, const Vector2d& _t )
+{
+	// Copy everything first (colors, texture coordinates and z), positions are overwritten below.
+	if( _dst != _src && _n )
+	{
+		std::copy( _src, _src + _n, _dst );
+	}
+
+	const float m[4] = { _m.getElement(0), _m.getElement(1), _m.getElement(2), _m.getElement(3) };
+	unsigned int i = 0;
+
+#if PH_SIMD_AVX2
+	if( CpuHasAVX2() ) i = transformAVX2< true >( _dst, _src, _n, m, _t.getX(), _t.getY() );
+#endif
+#if PH_SIMD_SSE2
+	i += transformSSE2< true >( _dst + i, _src + i, _n - i, m, _t.getX(), _t.getY() );
+#endif
+
+	transformScalar( _dst, _src, i, _n, m, _t.getX(), _t.getY() );
+
+	if( _t.getZ() != 0.0f )
+	{
+		for( unsigned int j = 0; j < _n; ++j )
+		{
+			positionOf( _dst + j )[2] += _t.getZ();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Colorize
+////////////////////////////////////////////////////////////////////////////////
+
+void phoenix::ColorizeVertices( Vertex* _v, unsigned int _n, const Color& _c )
+{
+	/*
+		The color is a single 32-bit word inside a 32 byte vertex, so there is nothing to gain
+		from wide registers here; the win is writing one packed word per vertex instead of
+		copying the color byte by byte.
+	*/
+	const Color c( _c );
+	unsigned int i = 0;
+	for( ; i + 4 <= _n; i += 4 )
+	{
+		std::memcpy( colorBytesOf( _v + i ), &c, sizeof( Color ) );
+		std::memcpy( colorBytesOf( _v + i + 1 ), &c, sizeof( Color ) );
+		std::memcpy( colorBytesOf( _v + i + 2 ), &c, sizeof( Color ) );
+		std::memcpy( colorBytesOf( _v + i + 3 ), &c, sizeof( Color ) );
+	}
+	for( ; i < _n; ++i )
+	{
+		std::memcpy( colorBytesOf( _v + i ), &c, sizeof( Color ) );
+	}
+}
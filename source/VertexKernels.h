@@ -0,0 +1,69 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+#ifndef __PHVERTEXKERNELS_H__
+#define __PHVERTEXKERNELS_H__
+
+#include "config.h"
+#include "Vertex.h"
+#include "RotationMatrix.h"
+
+namespace phoenix
+{
+
+	/*
+		Bulk vertex kernels.
+
+		These functions operate on contiguous spans of vertices and are used by BatchGeometry
+		for its transformations. They use SSE2 or AVX2 (chosen at runtime) when available and
+		fall back to plain scalar loops otherwise. All paths produce the same results as the
+		equivalent per-vertex Vector2d operations.
+	*/
+
+	//! Translate a span of vertices.
+	/*!
+		\f$ v_n = v_n + t \f$
+		\param _v The first vertex.
+		\param _n The number of vertices.
+		\param _t The translation (z is applied as well).
+	*/
+	void TranslateVertices( Vertex* _v, unsigned int _n, const Vector2d& _t );
+
+	//! Scale a span of vertices.
+	/*!
+		\f$ v_n = ( v_{nx} * s_x , v_{ny} * s_y ) \f$
+	*/
+	void ScaleVertices( Vertex* _v, unsigned int _n, const Vector2d& _s );
+
+	//! Rotate a span of vertices by the given matrix.
+	/*!
+		\f$ v_n = v_n * m \f$
+	*/
+	void RotateVertices( Vertex* _v, unsigned int _n, const RotationMatrix& _m );
+
+	//! Affine transform of a span of vertices.
+	/*!
+		Writes the source vertices to the destination with their positions multiplied by the
+		given matrix and then translated, all in a single pass. Colors and texture coordinates
+		are copied. The source and destination may be the same span.
+		\f$ d_n = s_n * m + t \f$
+		\param _dst The destination vertices.
+		\param _src The source vertices.
+		\param _n The number of vertices.
+		\param _m The linear part of the transform (rotation and scale).
+		\param _t The translation.
+	*/
+	void TransformVertices( Vertex* _dst, const Vertex* _src, unsigned int _n, const RotationMatrix& _m, const Vector2d& _t );
+
+	//! Set the color of a span of vertices.
+	void ColorizeVertices( Vertex* _v, unsigned int _n, const Color& _c );
+
+} //namespace phoenix
+
+#endif //__PHVERTEXKERNELS_H__
@@ -19,6 +19,11 @@
 */
 #define PH_USE_GLFW 1
 
+//! Define this to 1 to use SSE2/AVX2 kernels for bulk vertex and pixel operations, or 0 to use only the scalar versions.
+#ifndef PH_USE_SIMD
+#define PH_USE_SIMD 1
+#endif
+
 #if defined(__GNUC__) && (defined(__linux__) || defined(__linux) || defined(WIN32) || defined(__WIN32__) || defined(__WIN32))
 // Define this to ensure correct linkage with boost threads in MinGW 4.7+.
 #ifndef BOOST_THREAD_USE_LIB
@@ -13,6 +13,34 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+/*	SSE2 is on every x86-64 processor	*/
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+	#define SOIL_DXT_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define SOIL_DXT_SSE2 0
+#endif
+
+/*	the most threads to compress an image with (1 compresses serially)	*/
+#ifndef SOIL_DXT_MAX_THREADS
+#define SOIL_DXT_MAX_THREADS 16
+#endif
+
+/*	the fewest 4x4 blocks worth giving a thread	*/
+#ifndef SOIL_DXT_MIN_THREAD_BLOCKS
+#define SOIL_DXT_MIN_THREAD_BLOCKS 1024
+#endif
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
@@ -98,36 +126,35 @@ int
 	return 1;
 }
 
-unsigned char* convert_image_to_DXT1(
-		const unsigned char *const uncompressed,
-		int width, int height, int channels,
-		int *out_size )
+/*	one slice of block rows of an image to compress	*/
+typedef struct
 {
+	const unsigned char *uncompressed;
 	unsigned char *compressed;
+	int width, height, channels;
+	int first_row, last_row;
+	int has_alpha_blocks;
+} DXT_job;
+
+/*	compresses the block rows [first_row,last_row) of a job to DXT1	*/
+static void compress_DXT1_rows( const DXT_job *job )
+{
+	const unsigned char *const uncompressed = job->uncompressed;
+	unsigned char *const compressed = job->compressed;
+	const int width = job->width, height = job->height, channels = job->channels;
 	int i, j, x, y;
 	unsigned char ublock[16*3];
 	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || (channels > 4) )
-	{
-		return NULL;
-	}
+	int chan_step = 1;
+	/*	each block row starts at a known place in the output	*/
+	int index = job->first_row * ((width+3) >> 2) * 8;
 	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
 	if( channels < 3 )
 	{
 		chan_step = 0;
 	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	for( j = job->first_row * 4; j < job->last_row * 4 && j < height; j += 4 )
 	{
 		for( i = 0; i < width; i += 4 )
 		{
@@ -167,7 +194,6 @@ unsigned char* convert_image_to_DXT1(
 				}
 			}
 			/*	compress the block	*/
-			++block_count;
 			compress_DDS_color_block( 3, ublock, cblock );
 			/*	copy the data from the block into the main block	*/
 			for( x = 0; x < 8; ++x )
@@ -176,28 +202,21 @@ unsigned char* convert_image_to_DXT1(
 			}
 		}
 	}
-	return compressed;
 }
 
-unsigned char* convert_image_to_DXT5(
-		const unsigned char *const uncompressed,
-		int width, int height, int channels,
-		int *out_size )
+/*	compresses the block rows [first_row,last_row) of a job to DXT5	*/
+static void compress_DXT5_rows( const DXT_job *job )
 {
-	unsigned char *compressed;
+	const unsigned char *const uncompressed = job->uncompressed;
+	unsigned char *const compressed = job->compressed;
+	const int width = job->width, height = job->height, channels = job->channels;
 	int i, j, x, y;
 	unsigned char ublock[16*4];
 	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || ( channels > 4) )
-	{
-		return NULL;
-	}
+	int chan_step = 1;
+	int has_alpha;
+	/*	each block row starts at a known place in the output	*/
+	int index = job->first_row * ((width+3) >> 2) * 16;
 	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
 	if( channels < 3 )
 	{
@@ -205,12 +224,8 @@ unsigned char* convert_image_to_DXT5(
 	}
 	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
 	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	for( j = job->first_row * 4; j < job->last_row * 4 && j < height; j += 4 )
 	{
 		for( i = 0; i < width; i += 4 )
 		{
@@ -262,7 +277,6 @@ unsigned char* convert_image_to_DXT5(
 				compressed[index++] = cblock[x];
 			}
 			/*	then compress the color block	*/
-			++block_count;
 			compress_DDS_color_block( 4, ublock, cblock );
 			/*	copy the data from the compressed color block into the main buffer	*/
 			for( x = 0; x < 8; ++x )
@@ -271,6 +285,170 @@ unsigned char* convert_image_to_DXT5(
 			}
 		}
 	}
+}
+
+static void compress_DXT_job( const DXT_job *job )
+{
+	if( job->has_alpha_blocks )
+	{
+		compress_DXT5_rows( job );
+	} else
+	{
+		compress_DXT1_rows( job );
+	}
+}
+
+#ifdef WIN32
+static DWORD WINAPI DXT_thread( LPVOID arg )
+{
+	compress_DXT_job( (const DXT_job*)arg );
+	return 0;
+}
+#else
+static void* DXT_thread( void *arg )
+{
+	compress_DXT_job( (const DXT_job*)arg );
+	return NULL;
+}
+#endif
+
+/*	how many threads to compress with	*/
+static int DXT_thread_count( void )
+{
+	int n = 1;
+	#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	n = (int)info.dwNumberOfProcessors;
+	#elif defined(_SC_NPROCESSORS_ONLN)
+	n = (int)sysconf( _SC_NPROCESSORS_ONLN );
+	#endif
+	if( n < 1 )
+	{
+		n = 1;
+	} else if( n > SOIL_DXT_MAX_THREADS )
+	{
+		n = SOIL_DXT_MAX_THREADS;
+	}
+	return n;
+}
+
+/*
+	Compresses an image in slices of block rows, one per thread.
+	Every block is compressed on its own and written to its own
+	place, so the result is the same as compressing serially.
+*/
+static void compress_DXT_image(
+		const unsigned char *const uncompressed,
+		unsigned char *compressed,
+		int width, int height, int channels,
+		int has_alpha_blocks )
+{
+	DXT_job jobs[SOIL_DXT_MAX_THREADS];
+	#ifdef WIN32
+	HANDLE threads[SOIL_DXT_MAX_THREADS];
+	#else
+	pthread_t threads[SOIL_DXT_MAX_THREADS];
+	#endif
+	int started[SOIL_DXT_MAX_THREADS];
+	const int rows = (height+3) >> 2;
+	const int blocks = rows * ((width+3) >> 2);
+	int n = DXT_thread_count();
+	int t;
+	/*	small images (and MIPmap levels) aren't worth a thread	*/
+	if( n > blocks / SOIL_DXT_MIN_THREAD_BLOCKS )
+	{
+		n = blocks / SOIL_DXT_MIN_THREAD_BLOCKS;
+	}
+	if( n > rows )
+	{
+		n = rows;
+	}
+	if( n < 1 )
+	{
+		n = 1;
+	}
+	for( t = 0; t < n; ++t )
+	{
+		jobs[t].uncompressed = uncompressed;
+		jobs[t].compressed = compressed;
+		jobs[t].width = width;
+		jobs[t].height = height;
+		jobs[t].channels = channels;
+		jobs[t].first_row = rows * t / n;
+		jobs[t].last_row = rows * (t+1) / n;
+		jobs[t].has_alpha_blocks = has_alpha_blocks;
+	}
+	/*	the 1st slice is done here, a slice whose thread can't start is too	*/
+	for( t = 1; t < n; ++t )
+	{
+		#ifdef WIN32
+		threads[t] = CreateThread( NULL, 0, DXT_thread, &jobs[t], 0, NULL );
+		started[t] = (threads[t] != NULL);
+		#else
+		started[t] = (pthread_create( &threads[t], NULL, DXT_thread, &jobs[t] ) == 0);
+		#endif
+	}
+	compress_DXT_job( &jobs[0] );
+	for( t = 1; t < n; ++t )
+	{
+		if( !started[t] )
+		{
+			compress_DXT_job( &jobs[t] );
+			continue;
+		}
+		#ifdef WIN32
+		WaitForSingleObject( threads[t], INFINITE );
+		CloseHandle( threads[t] );
+		#else
+		pthread_join( threads[t], NULL );
+		#endif
+	}
+}
+
+unsigned char* convert_image_to_DXT1(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	unsigned char *compressed;
+	/*	error check	*/
+	*out_size = 0;
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) ||
+		(channels < 1) || (channels > 4) )
+	{
+		return NULL;
+	}
+	/*	get the RAM for the compressed image
+		(8 bytes per 4x4 pixel block)	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
+	compressed = (unsigned char*)malloc( *out_size );
+	/*	go through each block	*/
+	compress_DXT_image( uncompressed, compressed, width, height, channels, 0 );
+	return compressed;
+}
+
+unsigned char* convert_image_to_DXT5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	unsigned char *compressed;
+	/*	error check	*/
+	*out_size = 0;
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) ||
+		(channels < 1) || ( channels > 4) )
+	{
+		return NULL;
+	}
+	/*	get the RAM for the compressed image
+		(16 bytes per 4x4 pixel block)	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
+	compressed = (unsigned char*)malloc( *out_size );
+	/*	go through each block	*/
+	compress_DXT_image( uncompressed, compressed, width, height, channels, 1 );
 	return compressed;
 }
 
@@ -296,30 +474,106 @@ void rgb_888_from_565( unsigned int c, int *r, int *g, int *b )
 	*b = convert_bit_range( (c >> 00) & 31, 5, 8 );
 }
 
+/*
+	The sums (r, g, b) and sums of products (rr, gg, bb, rg, rb, gb)
+	of the 16 colors of a block.  They are all integers below 2^24,
+	so they are exactly what summing them up in floats gives.
+*/
+#if SOIL_DXT_SSE2
+static void compute_color_sums(
+		const unsigned char *const uncompressed,
+		int channels,
+		int sums[9] )
+{
+	/*	split the block into planes of 16 bytes	*/
+	unsigned char planes[3][16];
+	__m128i zero, r, g, b, r_lo, r_hi, g_lo, g_hi, b_lo, b_hi, s;
+	int i;
+	int out[4];
+	for( i = 0; i < 16; ++i )
+	{
+		planes[0][i] = uncompressed[i*channels+0];
+		planes[1][i] = uncompressed[i*channels+1];
+		planes[2][i] = uncompressed[i*channels+2];
+	}
+	zero = _mm_setzero_si128();
+	r = _mm_loadu_si128( (const __m128i*)planes[0] );
+	g = _mm_loadu_si128( (const __m128i*)planes[1] );
+	b = _mm_loadu_si128( (const __m128i*)planes[2] );
+	/*	plain sums: sum of absolute differences with 0	*/
+	s = _mm_sad_epu8( r, zero );
+	sums[0] = _mm_cvtsi128_si32( s ) + _mm_cvtsi128_si32( _mm_srli_si128( s, 8 ) );
+	s = _mm_sad_epu8( g, zero );
+	sums[1] = _mm_cvtsi128_si32( s ) + _mm_cvtsi128_si32( _mm_srli_si128( s, 8 ) );
+	s = _mm_sad_epu8( b, zero );
+	sums[2] = _mm_cvtsi128_si32( s ) + _mm_cvtsi128_si32( _mm_srli_si128( s, 8 ) );
+	/*	products: widen to 16 bits and multiply-add pairs	*/
+	r_lo = _mm_unpacklo_epi8( r, zero );
+	r_hi = _mm_unpackhi_epi8( r, zero );
+	g_lo = _mm_unpacklo_epi8( g, zero );
+	g_hi = _mm_unpackhi_epi8( g, zero );
+	b_lo = _mm_unpacklo_epi8( b, zero );
+	b_hi = _mm_unpackhi_epi8( b, zero );
+	#define SOIL_DXT_DOT( index, a_lo, a_hi, b_lo, b_hi ) \
+		s = _mm_add_epi32( _mm_madd_epi16( a_lo, b_lo ), _mm_madd_epi16( a_hi, b_hi ) ); \
+		_mm_storeu_si128( (__m128i*)out, s ); \
+		sums[index] = out[0] + out[1] + out[2] + out[3];
+	SOIL_DXT_DOT( 3, r_lo, r_hi, r_lo, r_hi )
+	SOIL_DXT_DOT( 4, g_lo, g_hi, g_lo, g_hi )
+	SOIL_DXT_DOT( 5, b_lo, b_hi, b_lo, b_hi )
+	SOIL_DXT_DOT( 6, r_lo, r_hi, g_lo, g_hi )
+	SOIL_DXT_DOT( 7, r_lo, r_hi, b_lo, b_hi )
+	SOIL_DXT_DOT( 8, g_lo, g_hi, b_lo, b_hi )
+	#undef SOIL_DXT_DOT
+}
+#else
+static void compute_color_sums(
+		const unsigned char *const uncompressed,
+		int channels,
+		int sums[9] )
+{
+	int i;
+	for( i = 0; i < 9; ++i )
+	{
+		sums[i] = 0;
+	}
+	for( i = 0; i < 16*channels; i += channels )
+	{
+		sums[0] += uncompressed[i+0];
+		sums[1] += uncompressed[i+1];
+		sums[2] += uncompressed[i+2];
+		sums[3] += uncompressed[i+0] * uncompressed[i+0];
+		sums[4] += uncompressed[i+1] * uncompressed[i+1];
+		sums[5] += uncompressed[i+2] * uncompressed[i+2];
+		sums[6] += uncompressed[i+0] * uncompressed[i+1];
+		sums[7] += uncompressed[i+0] * uncompressed[i+2];
+		sums[8] += uncompressed[i+1] * uncompressed[i+2];
+	}
+}
+#endif
+
 void compute_color_line_STDEV(
 		const unsigned char *const uncompressed,
 		int channels,
 		float point[3], float direction[3] )
 {
 	const float inv_16 = 1.0f / 16.0f;
-	int i;
-	float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
-	float sum_rr = 0.0f, sum_gg = 0.0f, sum_bb = 0.0f;
-	float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
+	int sums[9];
+	float sum_r, sum_g, sum_b;
+	float sum_rr, sum_gg, sum_bb;
+	float sum_rg, sum_rb, sum_gb;
 	/*	calculate all data needed for the covariance matrix
 		( to compare with _rygdxt code)	*/
-	for( i = 0; i < 16*channels; i += channels )
-	{
-		sum_r += uncompressed[i+0];
-		sum_rr += uncompressed[i+0] * uncompressed[i+0];
-		sum_g += uncompressed[i+1];
-		sum_gg += uncompressed[i+1] * uncompressed[i+1];
-		sum_b += uncompressed[i+2];
-		sum_bb += uncompressed[i+2] * uncompressed[i+2];
-		sum_rg += uncompressed[i+0] * uncompressed[i+1];
-		sum_rb += uncompressed[i+0] * uncompressed[i+2];
-		sum_gb += uncompressed[i+1] * uncompressed[i+2];
-	}
+	compute_color_sums( uncompressed, channels, sums );
+	sum_r = (float)sums[0];
+	sum_g = (float)sums[1];
+	sum_b = (float)sums[2];
+	sum_rr = (float)sums[3];
+	sum_gg = (float)sums[4];
+	sum_bb = (float)sums[5];
+	sum_rg = (float)sums[6];
+	sum_rb = (float)sums[7];
+	sum_gb = (float)sums[8];
 	/*	convert the sums to averages	*/
 	sum_r *= inv_16;
 	sum_g *= inv_16;
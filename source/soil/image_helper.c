@@ -8,8 +8,313 @@
 
 #include "image_helper.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+/*	SSE2 is on every x86-64 processor	*/
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+	#define SOIL_HELPER_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define SOIL_HELPER_SSE2 0
+#endif
+
+/*	AVX2 functions are compiled on their own and only called
+	when the processor has it (see cpu_has_AVX2)	*/
+#if SOIL_HELPER_SSE2 && defined(__GNUC__) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) || defined(__clang__) )
+	#define SOIL_HELPER_AVX2 1
+	#define SOIL_TARGET_AVX2 __attribute__((target("avx2")))
+	#include <immintrin.h>
+#elif SOIL_HELPER_SSE2 && defined(_MSC_VER) && _MSC_VER >= 1700
+	#define SOIL_HELPER_AVX2 1
+	#define SOIL_TARGET_AVX2
+	#include <immintrin.h>
+	#include <intrin.h>
+#else
+	#define SOIL_HELPER_AVX2 0
+	#define SOIL_TARGET_AVX2
+#endif
+
+/*	the SIMD versions are used unless turned off	*/
+static int use_SIMD = 1;
+
+void image_helper_use_SIMD( int enable )
+{
+	use_SIMD = enable;
+}
+
+#if SOIL_HELPER_AVX2
+static int cpu_has_AVX2( void )
+{
+	static int avx2 = -1;
+	if( avx2 < 0 )
+	{
+		#if defined(__GNUC__)
+		avx2 = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+		#else
+		int info[4];
+		avx2 = 0;
+		__cpuid( info, 0 );
+		if( info[0] >= 7 )
+		{
+			__cpuid( info, 1 );
+			/*	OSXSAVE and AVX, and the OS saves the YMM registers	*/
+			if( ((info[2] & ((1<<27) | (1<<28))) == ((1<<27) | (1<<28))) &&
+				((_xgetbv( 0 ) & 6) == 6) )
+			{
+				__cpuidex( info, 7, 0 );
+				avx2 = (info[1] & (1<<5)) != 0;
+			}
+		}
+		#endif
+	}
+	return avx2;
+}
+#endif
+
+#if SOIL_HELPER_SSE2
+/*	4 bytes to 4 floats	*/
+static __m128 load_RGBA_ps( const unsigned char *p )
+{
+	int v;
+	__m128i zero = _mm_setzero_si128();
+	memcpy( &v, p, 4 );
+	return _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( v ), zero ), zero ) );
+}
+
+/*	4 floats to 4 bytes (truncated, like a cast)	*/
+static void store_RGBA_ps( unsigned char *p, __m128 f )
+{
+	__m128i v = _mm_cvttps_epi32( f );
+	int out;
+	v = _mm_packs_epi32( v, v );
+	out = _mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+	memcpy( p, &out, 4 );
+}
+
+/*
+	Bilinear upscaling of an RGBA image, the 4 channels of a pixel at
+	once.  Same operations in the same order as the scalar version.
+*/
+static void up_scale_RGBA_SSE2(
+		const unsigned char* const orig,
+		int width, int height,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		float dx, float dy )
+{
+	int x, y;
+	const __m128 half = _mm_set1_ps( 0.5f );
+	for ( y = 0; y < resampled_height; ++y )
+	{
+		float sampley = y * dy;
+		int inty = (int)sampley;
+		__m128 wy0, wy1;
+		if( inty > height - 2 ) { inty = height - 2; }
+		sampley -= inty;
+		wy0 = _mm_set1_ps( 1.0f-sampley );
+		wy1 = _mm_set1_ps( sampley );
+		for ( x = 0; x < resampled_width; ++x )
+		{
+			float samplex = x * dx;
+			int intx = (int)samplex;
+			const unsigned char *base;
+			__m128 wx0, wx1, value;
+			if( intx > width - 2 ) { intx = width - 2; }
+			samplex -= intx;
+			wx0 = _mm_set1_ps( 1.0f-samplex );
+			wx1 = _mm_set1_ps( samplex );
+			base = orig + (inty * width + intx) * 4;
+			value = _mm_add_ps( half, _mm_mul_ps( _mm_mul_ps( load_RGBA_ps( base ), wx0 ), wy0 ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_RGBA_ps( base+4 ), wx1 ), wy0 ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_RGBA_ps( base+width*4 ), wx0 ), wy1 ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_RGBA_ps( base+width*4+4 ), wx1 ), wy1 ) );
+			store_RGBA_ps( resampled + (y*resampled_width + x) * 4, value );
+		}
+	}
+}
+
+/*
+	2x2 box filter of RGBA rows: 8 source pixels from each row
+	make 4 MIPmap pixels.  \return how many pixels were made.
+*/
+static int mipmap_RGBA_row_SSE2(
+		const unsigned char *row0, const unsigned char *row1,
+		unsigned char *out, int n )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16( 2 );
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m128i a, b, lo, hi, s0, s1;
+		/*	source pixels 0-3	*/
+		a = _mm_loadu_si128( (const __m128i*)(row0 + i*8) );
+		b = _mm_loadu_si128( (const __m128i*)(row1 + i*8) );
+		lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+		hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+		s0 = _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ), _mm_unpackhi_epi64( lo, hi ) );
+		/*	source pixels 4-7	*/
+		a = _mm_loadu_si128( (const __m128i*)(row0 + i*8 + 16) );
+		b = _mm_loadu_si128( (const __m128i*)(row1 + i*8 + 16) );
+		lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+		hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+		s1 = _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ), _mm_unpackhi_epi64( lo, hi ) );
+		/*	(sum + 2) / 4	*/
+		s0 = _mm_srli_epi16( _mm_add_epi16( s0, two ), 2 );
+		s1 = _mm_srli_epi16( _mm_add_epi16( s1, two ), 2 );
+		_mm_storeu_si128( (__m128i*)(out + i*4), _mm_packus_epi16( s0, s1 ) );
+	}
+	return i;
+}
+
+/*
+	the scaling of scale_image_RGB_to_NTSC_safe, 16 bytes at a time,
+	keeping every 4th (alpha) byte if keep_alpha
+*/
+static void scale_NTSC_SSE2( unsigned char *p, int n, float range, float lo, int keep_alpha )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 r = _mm_set1_ps( range );
+	const __m128 l = _mm_set1_ps( lo );
+	const __m128 d = _mm_set1_ps( 255.0f );
+	const __m128i alpha = keep_alpha ? _mm_set1_epi32( (int)0xFF000000 ) : zero;
+	int i;
+	for( i = 0; i + 16 <= n; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)(p + i) );
+		__m128i w0 = _mm_unpacklo_epi8( v, zero ), w1 = _mm_unpackhi_epi8( v, zero );
+		__m128i q[4];
+		int k;
+		q[0] = _mm_unpacklo_epi16( w0, zero );
+		q[1] = _mm_unpackhi_epi16( w0, zero );
+		q[2] = _mm_unpacklo_epi16( w1, zero );
+		q[3] = _mm_unpackhi_epi16( w1, zero );
+		for( k = 0; k < 4; ++k )
+		{
+			q[k] = _mm_cvttps_epi32( _mm_add_ps( _mm_div_ps( _mm_mul_ps( r, _mm_cvtepi32_ps( q[k] ) ), d ), l ) );
+		}
+		w0 = _mm_packus_epi16( _mm_packs_epi32( q[0], q[1] ), _mm_packs_epi32( q[2], q[3] ) );
+		_mm_storeu_si128( (__m128i*)(p + i), _mm_or_si128( _mm_andnot_si128( alpha, w0 ), _mm_and_si128( alpha, v ) ) );
+	}
+}
+
+/*	clamps 4 ints to [0,255]	*/
+static __m128i clamp_byte_epi32( __m128i x )
+{
+	const __m128i zero = _mm_setzero_si128();
+	x = _mm_packs_epi32( x, x );
+	x = _mm_packus_epi16( x, x );
+	return _mm_unpacklo_epi16( _mm_unpacklo_epi8( x, zero ), zero );
+}
+
+/*	convert_RGB_to_YCoCg for 4 channels, 4 pixels at a time	*/
+static int RGBA_to_CoCgAY_SSE2( unsigned char *p, int n )
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	const __m128i c1 = _mm_set1_epi32( 1 ), c2 = _mm_set1_epi32( 2 ), c128 = _mm_set1_epi32( 128 );
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)(p + i*4) );
+		__m128i r = _mm_and_si128( v, mask );
+		__m128i g = _mm_srli_epi32( _mm_add_epi32( _mm_and_si128( _mm_srli_epi32( v, 8 ), mask ), c1 ), 1 );
+		__m128i b = _mm_and_si128( _mm_srli_epi32( v, 16 ), mask );
+		__m128i a = _mm_srli_epi32( v, 24 );
+		__m128i tmp = _mm_srai_epi32( _mm_add_epi32( c2, _mm_add_epi32( r, b ) ), 2 );
+		__m128i co = clamp_byte_epi32( _mm_add_epi32( c128, _mm_srai_epi32( _mm_add_epi32( _mm_sub_epi32( r, b ), c1 ), 1 ) ) );
+		__m128i cg = clamp_byte_epi32( _mm_sub_epi32( _mm_add_epi32( c128, g ), tmp ) );
+		__m128i y = clamp_byte_epi32( _mm_add_epi32( g, tmp ) );
+		v = _mm_or_si128( _mm_or_si128( co, _mm_slli_epi32( cg, 8 ) ), _mm_or_si128( _mm_slli_epi32( a, 16 ), _mm_slli_epi32( y, 24 ) ) );
+		_mm_storeu_si128( (__m128i*)(p + i*4), v );
+	}
+	return i;
+}
+
+/*	convert_YCoCg_to_RGB for 4 channels, 4 pixels at a time	*/
+static int CoCgAY_to_RGBA_SSE2( unsigned char *p, int n )
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	const __m128i c128 = _mm_set1_epi32( 128 );
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)(p + i*4) );
+		__m128i co = _mm_sub_epi32( _mm_and_si128( v, mask ), c128 );
+		__m128i cg = _mm_sub_epi32( _mm_and_si128( _mm_srli_epi32( v, 8 ), mask ), c128 );
+		__m128i a = _mm_and_si128( _mm_srli_epi32( v, 16 ), mask );
+		__m128i y = _mm_srli_epi32( v, 24 );
+		__m128i r = clamp_byte_epi32( _mm_sub_epi32( _mm_add_epi32( y, co ), cg ) );
+		__m128i g = clamp_byte_epi32( _mm_add_epi32( y, cg ) );
+		__m128i b = clamp_byte_epi32( _mm_sub_epi32( _mm_sub_epi32( y, co ), cg ) );
+		v = _mm_or_si128( _mm_or_si128( r, _mm_slli_epi32( g, 8 ) ), _mm_or_si128( _mm_slli_epi32( b, 16 ), _mm_slli_epi32( a, 24 ) ) );
+		_mm_storeu_si128( (__m128i*)(p + i*4), v );
+	}
+	return i;
+}
+#endif
+
+#if SOIL_HELPER_AVX2
+/*	mipmap_RGBA_row_SSE2, 16 source pixels from each row at a time	*/
+SOIL_TARGET_AVX2 static int mipmap_RGBA_row_AVX2(
+		const unsigned char *row0, const unsigned char *row1,
+		unsigned char *out, int n )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i two = _mm256_set1_epi16( 2 );
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m256i a, b, lo, hi, s0, s1;
+		/*	unpacking works within 128 bit lanes, so this is the same as SSE2 twice over	*/
+		a = _mm256_loadu_si256( (const __m256i*)(row0 + i*8) );
+		b = _mm256_loadu_si256( (const __m256i*)(row1 + i*8) );
+		lo = _mm256_add_epi16( _mm256_unpacklo_epi8( a, zero ), _mm256_unpacklo_epi8( b, zero ) );
+		hi = _mm256_add_epi16( _mm256_unpackhi_epi8( a, zero ), _mm256_unpackhi_epi8( b, zero ) );
+		s0 = _mm256_add_epi16( _mm256_unpacklo_epi64( lo, hi ), _mm256_unpackhi_epi64( lo, hi ) );
+		a = _mm256_loadu_si256( (const __m256i*)(row0 + i*8 + 32) );
+		b = _mm256_loadu_si256( (const __m256i*)(row1 + i*8 + 32) );
+		lo = _mm256_add_epi16( _mm256_unpacklo_epi8( a, zero ), _mm256_unpacklo_epi8( b, zero ) );
+		hi = _mm256_add_epi16( _mm256_unpackhi_epi8( a, zero ), _mm256_unpackhi_epi8( b, zero ) );
+		s1 = _mm256_add_epi16( _mm256_unpacklo_epi64( lo, hi ), _mm256_unpackhi_epi64( lo, hi ) );
+		s0 = _mm256_srli_epi16( _mm256_add_epi16( s0, two ), 2 );
+		s1 = _mm256_srli_epi16( _mm256_add_epi16( s1, two ), 2 );
+		/*	the pack leaves the pixels in the order 0 1 4 5 2 3 6 7	*/
+		_mm256_storeu_si256( (__m256i*)(out + i*4),
+			_mm256_permute4x64_epi64( _mm256_packus_epi16( s0, s1 ), _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+	}
+	return i;
+}
+#endif
+
+/*	2x2 box filter of one row of the MIPmap	*/
+static void mipmap_row_2x2(
+		const unsigned char *row0, const unsigned char *row1,
+		unsigned char *out, int mip_width, int channels )
+{
+	int i = 0, c;
+	#if SOIL_HELPER_SSE2
+	if( use_SIMD && (channels == 4) )
+	{
+		#if SOIL_HELPER_AVX2
+		if( cpu_has_AVX2() )
+		{
+			i = mipmap_RGBA_row_AVX2( row0, row1, out, mip_width );
+		}
+		#endif
+		i += mipmap_RGBA_row_SSE2( row0 + i*8, row1 + i*8, out + i*4, mip_width - i );
+	}
+	#endif
+	for( ; i < mip_width; ++i )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			const int k = i*2*channels + c;
+			out[i*channels + c] = (2 + row0[k] + row0[k+channels] + row1[k] + row1[k+channels]) >> 2;
+		}
+	}
+}
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -38,6 +343,13 @@ int
 	*/
     dx = (width - 1.0f) / (resampled_width - 1.0f);
     dy = (height - 1.0f) / (resampled_height - 1.0f);
+	#if SOIL_HELPER_SSE2
+	if( use_SIMD && (channels == 4) && (width > 1) && (height > 1) )
+	{
+		up_scale_RGBA_SSE2( orig, width, height, resampled, resampled_width, resampled_height, dx, dy );
+		return 1;
+	}
+	#endif
     for ( y = 0; y < resampled_height; ++y )
     {
     	/* find the base y index and fractional offset from that	*/
@@ -112,6 +424,16 @@ int
 	{
 		mip_height = 1;
 	}
+	/*	the usual case: halving, with every block inside the image	*/
+	if( (block_size_x == 2) && (block_size_y == 2) && (width > 1) && (height > 1) )
+	{
+		for( j = 0; j < mip_height; ++j )
+		{
+			mipmap_row_2x2( orig + j*2*width*channels, orig + (j*2+1)*width*channels,
+				resampled + j*mip_width*channels, mip_width, channels );
+		}
+		return 1;
+	}
 	for( j = 0; j < mip_height; ++j )
 	{
 		for( i = 0; i < mip_width; ++i )
@@ -177,8 +499,17 @@ int
 	}
 	/*	for channels = 2 or 4, ignore the alpha component	*/
 	nc -= 1 - (channels & 1);
+	i = 0;
+	#if SOIL_HELPER_SSE2
+	/*	the same arithmetic as the table, 16 bytes at a time	*/
+	if( use_SIMD && ((channels == 4) || (channels == 1)) )
+	{
+		i = width*height*channels / 16 * 16;
+		scale_NTSC_SSE2( orig, i, scale_hi - scale_lo, scale_lo, channels == 4 );
+	}
+	#endif
 	/*	OK, go through the image and scale any non-alpha components	*/
-	for( i = 0; i < width*height*channels; i += channels )
+	for( ; i < width*height*channels; i += channels )
 	{
 		for( j = 0; j < nc; ++j )
 		{
@@ -231,7 +562,14 @@ int
 		}
 	} else
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		i = 0;
+		#if SOIL_HELPER_SSE2
+		if( use_SIMD )
+		{
+			i = RGBA_to_CoCgAY_SSE2( orig, width*height ) * 4;
+		}
+		#endif
+		for( ; i < width*height*4; i += 4 )
 		{
 			int r = orig[i+0];
 			int g = (orig[i+1] + 1) >> 1;
@@ -289,7 +627,14 @@ int
 		}
 	} else
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		i = 0;
+		#if SOIL_HELPER_SSE2
+		if( use_SIMD )
+		{
+			i = CoCgAY_to_RGBA_SSE2( orig, width*height ) * 4;
+		}
+		#endif
+		for( ; i < width*height*4; i += 4 )
 		{
 			int co = orig[i+0] - 128;
 			int cg = orig[i+1] - 128;
@@ -108,6 +108,17 @@ int
 		int rescale_to_max
 	);
 
+/**
+	Turns the SSE2/AVX2 versions of the functions above on (the
+	default) or off, for testing and benchmarking.  Both give the
+	same results.
+**/
+void
+	image_helper_use_SIMD
+	(
+		int enable
+	);
+
 #ifdef __cplusplus
 }
 #endif
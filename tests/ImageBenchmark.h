@@ -0,0 +1,246 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "Phoenix.h"
+#include "ImageKernels.h"
+#include "Simd.h"
+#include "soil/image_helper.h"
+
+using namespace phoenix;
+
+/*!
+    Microbenchmark for the bulk pixel kernels and SOIL's image helpers. It runs
+    per-pixel scalar loops (or the helpers with SIMD turned off) and the kernels
+    over the same image, checks that the results are identical and prints the
+    timings. It does not open a window.
+*/
+class ImageBenchmark
+{
+    public:
+
+        ImageBenchmark()
+            : width( 1024 ), height( 1024 ), passes( 50 )
+        {
+        }
+
+        virtual ~ImageBenchmark()
+        {
+        }
+
+        int run()
+        {
+            std::vector< unsigned char > source;
+            std::vector< unsigned char > reference;
+            std::vector< unsigned char > kernel;
+            makeImage( source, 1 );
+            makeImage( reference, 2 );
+            kernel = reference;
+
+            const unsigned int n = width * height;
+            const Color c( 255, 127, 64, 200 );
+
+            std::cout<<"Processing a "<<width<<"x"<<height<<" image "<<passes<<" times (AVX2 "<<( CpuHasAVX2() ? "available" : "unavailable" )<<").\n";
+
+            // Fill, the way Texture::build() used to do it.
+            double scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                for( unsigned int i = 0; i < n; ++i )
+                {
+                    reference[i*4+0] = c.getRed();
+                    reference[i*4+1] = c.getGreen();
+                    reference[i*4+2] = c.getBlue();
+                    reference[i*4+3] = c.getAlpha();
+                }
+            scalar = now() - scalar;
+            double simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                FillPixels( &kernel[0], n, c );
+            simd = now() - simd;
+            report( "fill", scalar, simd, reference, kernel );
+
+            // Swizzle
+            scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                for( unsigned int i = 0; i < n; ++i )
+                    std::swap( reference[i*4+0], reference[i*4+2] );
+            scalar = now() - scalar;
+            simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                SwizzlePixels( &kernel[0], &kernel[0], n );
+            simd = now() - simd;
+            report( "swizzle", scalar, simd, reference, kernel );
+
+            // Blend, one pass (more would just converge on the source).
+            makeImage( reference, 3 );
+            kernel = reference;
+            scalar = now();
+            for( unsigned int i = 0; i < n; ++i )
+            {
+                const unsigned int a = source[i*4+3];
+                for( unsigned int j = 0; j < 4; ++j )
+                {
+                    const unsigned int s = j == 3 ? 255 : source[i*4+j];
+                    reference[i*4+j] = (unsigned char)( ( s * a + reference[i*4+j] * ( 255 - a ) + 127 ) / 255 );
+                }
+            }
+            scalar = now() - scalar;
+            simd = now();
+            BlendPixels( &kernel[0], &source[0], n );
+            simd = now() - simd;
+            report( "blend", scalar, simd, reference, kernel );
+
+            // Premultiply, one pass.
+            scalar = now();
+            for( unsigned int i = 0; i < n; ++i )
+                for( unsigned int j = 0; j < 3; ++j )
+                    reference[i*4+j] = (unsigned char)( ( reference[i*4+j] * reference[i*4+3] + 128 ) >> 8 );
+            scalar = now() - scalar;
+            simd = now();
+            PremultiplyPixels( &kernel[0], n );
+            simd = now() - simd;
+            report( "premultiply", scalar, simd, reference, kernel );
+
+            // SOIL's image helpers, as used for mipmaps and power of two scaling.
+            std::cout<<"SOIL image helpers:\n";
+
+            // A full mipmap chain, every level below the source.
+            reference.assign( chainSize(), 0 );
+            kernel.assign( chainSize(), 0 );
+            scalar = now();
+            image_helper_use_SIMD( 0 );
+            for( unsigned int p = 0; p < passes; ++p )
+                mipmaps( source, reference );
+            scalar = now() - scalar;
+            simd = now();
+            image_helper_use_SIMD( 1 );
+            for( unsigned int p = 0; p < passes; ++p )
+                mipmaps( source, kernel );
+            simd = now() - simd;
+            report( "mipmap chain", scalar, simd, reference, kernel );
+
+            // Upscale to the next power of two.
+            const int sw = width - width / 3, sh = height - height / 3;
+            reference.assign( width * height * 4, 0 );
+            kernel.assign( width * height * 4, 0 );
+            scalar = now();
+            image_helper_use_SIMD( 0 );
+            for( unsigned int p = 0; p < passes; ++p )
+                up_scale_image( &source[0], sw, sh, 4, &reference[0], width, height );
+            scalar = now() - scalar;
+            simd = now();
+            image_helper_use_SIMD( 1 );
+            for( unsigned int p = 0; p < passes; ++p )
+                up_scale_image( &source[0], sw, sh, 4, &kernel[0], width, height );
+            simd = now() - simd;
+            report( "upscale", scalar, simd, reference, kernel );
+
+            // NTSC safe colors.
+            reference = source;
+            kernel = source;
+            scalar = now();
+            image_helper_use_SIMD( 0 );
+            for( unsigned int p = 0; p < passes; ++p )
+                scale_image_RGB_to_NTSC_safe( &reference[0], width, height, 4 );
+            scalar = now() - scalar;
+            simd = now();
+            image_helper_use_SIMD( 1 );
+            for( unsigned int p = 0; p < passes; ++p )
+                scale_image_RGB_to_NTSC_safe( &kernel[0], width, height, 4 );
+            simd = now() - simd;
+            report( "NTSC safe", scalar, simd, reference, kernel );
+
+            // YCoCg and back.
+            scalar = now();
+            image_helper_use_SIMD( 0 );
+            for( unsigned int p = 0; p < passes; ++p )
+            {
+                convert_RGB_to_YCoCg( &reference[0], width, height, 4 );
+                convert_YCoCg_to_RGB( &reference[0], width, height, 4 );
+            }
+            scalar = now() - scalar;
+            simd = now();
+            image_helper_use_SIMD( 1 );
+            for( unsigned int p = 0; p < passes; ++p )
+            {
+                convert_RGB_to_YCoCg( &kernel[0], width, height, 4 );
+                convert_YCoCg_to_RGB( &kernel[0], width, height, 4 );
+            }
+            simd = now() - simd;
+            report( "YCoCg", scalar, simd, reference, kernel );
+
+            return 0;
+
+        }// Run
+
+    protected:
+
+        //! Pseudo random pixels.
+        void makeImage( std::vector< unsigned char >& _image, unsigned int _seed )
+        {
+            std::srand( _seed );
+            _image.resize( width * height * 4 );
+            for( unsigned int i = 0; i < _image.size(); ++i )
+                _image[i] = (unsigned char)( std::rand() & 0xff );
+        }
+
+        //! Every mipmap level of an RGBA image, one after the other in _out (which must be large enough).
+        void mipmaps( const std::vector< unsigned char >& _image, std::vector< unsigned char >& _out )
+        {
+            const unsigned char* level = &_image[0];
+            unsigned char* out = &_out[0];
+            int w = width, h = height;
+            while( w > 1 || h > 1 )
+            {
+                mipmap_image( level, w, h, 4, out, 2, 2 );
+                w = w > 1 ? w / 2 : 1;
+                h = h > 1 ? h / 2 : 1;
+                level = out;
+                out += w * h * 4;
+            }
+        }
+
+        //! Bytes needed for every mipmap level below the full size image.
+        std::size_t chainSize()
+        {
+            std::size_t size = 0;
+            int w = width, h = height;
+            while( w > 1 || h > 1 )
+            {
+                w = w > 1 ? w / 2 : 1;
+                h = h > 1 ? h / 2 : 1;
+                size += w * h * 4;
+            }
+            return size;
+        }
+
+        //! Seconds since the epoch, with microsecond resolution.
+        double now()
+        {
+            using namespace boost::posix_time;
+            return double( ( microsec_clock::universal_time() - ptime( boost::gregorian::date( 1970, 1, 1 ) ) ).total_microseconds() ) / 1000000.0;
+        }
+
+        void report( const char* _name, double _scalar, double _simd, const std::vector< unsigned char >& _a, const std::vector< unsigned char >& _b )
+        {
+            const bool same = _a == _b;
+            std::cout<<"  "<<_name<<": scalar "<<_scalar * 1000.0<<"ms, kernel "<<_simd * 1000.0<<"ms ("
+                <<( _simd > 0.0 ? _scalar / _simd : 0.0 )<<"x) "<<( same ? "identical" : "MISMATCH" )<<"\n";
+        }
+
+        unsigned int width;
+        unsigned int height;
+        unsigned int passes;
+
+    private:
+};
@@ -0,0 +1,162 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+
+#include <vector>
+#include <iostream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "Phoenix.h"
+#include "VertexKernels.h"
+#include "Simd.h"
+
+using namespace phoenix;
+
+/*!
+    Microbenchmark for the bulk vertex kernels. It runs the old per-vertex
+    scalar loops and the kernels over the same sprite data, checks that the
+    results are identical and prints the timings. It does not open a window.
+*/
+class TransformBenchmark
+{
+    public:
+
+        TransformBenchmark()
+            : sprites( 20000 ), passes( 200 )
+        {
+        }
+
+        virtual ~TransformBenchmark()
+        {
+        }
+
+        int run()
+        {
+            std::vector< Vertex > reference;
+            std::vector< Vertex > kernel;
+            makeSprites( reference );
+            makeSprites( kernel );
+
+            const Vector2d t( 1.5f, -0.75f );
+            const Vector2d s( 1.001f, 0.999f );
+            const RotationMatrix m( 0.01f );
+            const Color c( 255, 127, 64, 200 );
+
+            std::cout<<"Transforming "<<reference.size()<<" vertices "<<passes<<" times (AVX2 "<<( CpuHasAVX2() ? "available" : "unavailable" )<<").\n";
+
+            // Translate
+            double scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                for( std::vector< Vertex >::iterator v = reference.begin(); v != reference.end(); ++v )
+                    v->position += t;
+            scalar = now() - scalar;
+            double simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                TranslateVertices( &kernel[0], kernel.size(), t );
+            simd = now() - simd;
+            report( "translate", scalar, simd, reference, kernel );
+
+            // Scale
+            scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                for( std::vector< Vertex >::iterator v = reference.begin(); v != reference.end(); ++v )
+                {
+                    v->position.setX( v->position.getX() * s.getX() );
+                    v->position.setY( v->position.getY() * s.getY() );
+                }
+            scalar = now() - scalar;
+            simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                ScaleVertices( &kernel[0], kernel.size(), s );
+            simd = now() - simd;
+            report( "scale", scalar, simd, reference, kernel );
+
+            // Rotate
+            scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                for( std::vector< Vertex >::iterator v = reference.begin(); v != reference.end(); ++v )
+                    v->position *= m;
+            scalar = now() - scalar;
+            simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                RotateVertices( &kernel[0], kernel.size(), m );
+            simd = now() - simd;
+            report( "rotate", scalar, simd, reference, kernel );
+
+            // Rotate + translate, fused.
+            scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+            {
+                for( std::vector< Vertex >::iterator v = reference.begin(); v != reference.end(); ++v )
+                    v->position *= m;
+                for( std::vector< Vertex >::iterator v = reference.begin(); v != reference.end(); ++v )
+                    v->position += t;
+            }
+            scalar = now() - scalar;
+            simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                TransformVertices( &kernel[0], &kernel[0], kernel.size(), m, t );
+            simd = now() - simd;
+            report( "transform", scalar, simd, reference, kernel );
+
+            // Colorize
+            scalar = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                for( std::vector< Vertex >::iterator v = reference.begin(); v != reference.end(); ++v )
+                    v->color = c;
+            scalar = now() - scalar;
+            simd = now();
+            for( unsigned int p = 0; p < passes; ++p )
+                ColorizeVertices( &kernel[0], kernel.size(), c );
+            simd = now() - simd;
+            report( "colorize", scalar, simd, reference, kernel );
+
+            return 0;
+
+        }// Run
+
+    protected:
+
+        //! Four vertices per sprite, laid out like GraphicsFactory2d::drawTexture() makes them.
+        void makeSprites( std::vector< Vertex >& _list )
+        {
+            _list.clear();
+            _list.reserve( sprites * 4 );
+            for( unsigned int i = 0; i < sprites; ++i )
+            {
+                Vector2d p( float( i % 640 ), float( i / 640 ) );
+                _list.push_back( Vertex( p, Color(), TextureCoords(0,0) ) );
+                _list.push_back( Vertex( p + Vector2d( 0, 32 ), Color(), TextureCoords(0,1) ) );
+                _list.push_back( Vertex( p + Vector2d( 32, 32 ), Color(), TextureCoords(1,1) ) );
+                _list.push_back( Vertex( p + Vector2d( 32, 0 ), Color(), TextureCoords(1,0) ) );
+            }
+        }
+
+        //! Seconds since the epoch, with microsecond resolution.
+        double now()
+        {
+            using namespace boost::posix_time;
+            return double( ( microsec_clock::universal_time() - ptime( boost::gregorian::date( 1970, 1, 1 ) ) ).total_microseconds() ) / 1000000.0;
+        }
+
+        void report( const char* _name, double _scalar, double _simd, const std::vector< Vertex >& _a, const std::vector< Vertex >& _b )
+        {
+            bool same = _a.size() == _b.size();
+            for( unsigned int i = 0; same && i < _a.size(); ++i )
+            {
+                same = _a[i].position == _b[i].position && _a[i].color.encode() == _b[i].color.encode();
+            }
+            std::cout<<"  "<<_name<<": scalar "<<_scalar * 1000.0<<"ms, kernel "<<_simd * 1000.0<<"ms ("
+                <<( _simd > 0.0 ? _scalar / _simd : 0.0 )<<"x) "<<( same ? "identical" : "MISMATCH" )<<"\n";
+        }
+
+        unsigned int sprites;
+        unsigned int passes;
+
+    private:
+};
@@ -53,6 +53,12 @@ distribution for more information.
 #ifdef _TESTS_GEOMETRY_
 	#include "GeometryTest.h"
 #endif
+#ifdef _TESTS_TRANSFORM_BENCHMARK_
+	#include "TransformBenchmark.h"
+#endif
+#ifdef _TESTS_IMAGE_BENCHMARK_
+	#include "ImageBenchmark.h"
+#endif
 #ifdef _TESTS_DEMO_
 	#include "Demo.h"
 #endif
@@ -99,6 +105,12 @@ int main()
 #ifdef _TESTS_GEOMETRY_
 		GeometryTest test;
 #endif
+#ifdef _TESTS_TRANSFORM_BENCHMARK_
+		TransformBenchmark test;
+#endif
+#ifdef _TESTS_IMAGE_BENCHMARK_
+		ImageBenchmark test;
+#endif
 #ifdef _TESTS_DEMO_
 		Demo test;
 #endif
@@ -0,0 +1,112 @@
+/*
+
+Copyright (c) 2010, Jonathan Wayne Parrott
+
+Please see the license.txt file included with this source
+distribution for more information.
+
+*/
+
+/*! Frame capture replay.
+    Loads a capture made with BatchRenderer::capture(), rebuilds its render graph in a new BatchRenderer and draws it
+    a number of times into an offscreen RenderTarget, then reports how long the draws took.
+
+    Usage: phoenix_replay capture [frames]
+
+    Textures are loaded from the captured names when those files exist, otherwise a blank texture of the captured
+    size is used in their place. Group states can't be replayed, their groups are drawn without them.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include "Phoenix.h"
+
+using namespace phoenix;
+
+int main( int argc, char** argv )
+{
+
+    if( argc < 2 )
+    {
+        std::cerr<<"Usage: phoenix_replay capture [frames]\n";
+        return 1;
+    }
+
+    FrameCapture capture;
+    if( ! capture.load( argv[1] ) )
+    {
+        std::cerr<<"Could not load capture "<<argv[1]<<"\n";
+        return 1;
+    }
+
+    unsigned int frames = argc > 2 ? std::max( 1, std::atoi( argv[2] ) ) : 100;
+
+    // The window only provides the GL context, everything is drawn into the render target.
+    Vector2d size = capture.view.getSize();
+    if( size.getX() < 1.0f || size.getY() < 1.0f ) size = Vector2d( 640, 480 );
+    RenderSystem system( size );
+    ResourceManager& resources = system.getResourceManager();
+
+    // Textures, by captured id.
+    std::map< unsigned int, TexturePtr > textures;
+    BOOST_FOREACH( const FrameCapture::TextureInfo& t, capture.textures )
+    {
+        TexturePtr texture;
+        if( std::ifstream( t.name.c_str() ).good() ) texture = system.loadTexture( t.name );
+        if( ! texture || ! texture->getTextureId() ) texture = new Texture( resources, Vector2d( float( t.width ), float( t.height ) ) );
+        textures[ t.id ] = texture;
+    }
+
+    // Rebuild the graph.
+    BatchRenderer renderer;
+    renderer.setView( capture.view );
+    renderer.setClearing( capture.clearing );
+    renderer.setClearColor( capture.clear_color );
+    renderer.setRenderTarget( new RenderTarget( resources, size ) );
+
+    BOOST_FOREACH( const FrameCapture::Bucket& b, capture.buckets )
+    {
+        BOOST_FOREACH( const FrameCapture::Geometry& g, b.geometry )
+        {
+            BatchGeometryPtr geom = new BatchGeometry( renderer, b.primitive, b.texture ? textures[ b.texture ] : TexturePtr(), b.group, b.depth );
+            geom->setBlendMode( BlendMode::fromKey( b.blend ) );
+            geom->setClipping( g.clip );
+            geom->setClippingRectangle( g.clip_rect );
+            geom->reserve( g.vertices.size() );
+            BOOST_FOREACH( const Vertex& v, g.vertices ) geom->addVertex( v );
+            geom->update();
+        }
+    }
+
+    std::cout<<"Replaying "<<argv[1]<<": "<<capture.buckets.size()<<" buckets, "<<capture.getGeometryCount()<<" geometry, "
+        <<capture.getVertexCount()<<" vertices, "<<capture.textures.size()<<" textures";
+    if( ! capture.groups.empty() ) std::cout<<" ("<<capture.groups.size()<<" group states not replayed)";
+    std::cout<<".\n";
+
+    // Warm up (uploads, first sync), then time each frame to completion.
+    renderer.draw( true );
+    glFinish();
+
+    std::vector< double > times;
+    times.reserve( frames );
+    Timer timer;
+    for( unsigned int i = 0; i < frames; ++i )
+    {
+        timer.reset();
+        renderer.draw( true );
+        glFinish();
+        times.push_back( timer.getTime() );
+    }
+
+    std::sort( times.begin(), times.end() );
+    double total = 0.0;
+    BOOST_FOREACH( double t, times ) total += t;
+
+    std::cout<<frames<<" frames: mean "<<( total / frames ) * 1000.0<<"ms, min "<<times.front() * 1000.0
+        <<"ms, median "<<times[ times.size() / 2 ] * 1000.0<<"ms, max "<<times.back() * 1000.0<<"ms\n";
+
+    return 0;
+
+}